@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <chrono>
+#include <crasy/crasy.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Usage: coop_latency_bench [milliseconds]
+//
+// Measures how late a light task wakes from a 1 ms sleep while another task
+// on the same thread floods it with work that never has to wait: an endless
+// stream, an uncontended mutex, UDP datagrams over loopback, or plain CPU
+// work with an explicit yield_now(). Everything runs on a local_executor, so
+// the flooding task and the light one share a single thread, and only the
+// task budget and yields stand between the light task and starvation.
+
+// Port of the UDP flood's receiving socket; the sender uses the next one
+inline constexpr crasy::port_type FLOOD_PORT = 43000;
+
+using namespace std::chrono_literals;
+
+crasy::endpoint loopback(crasy::port_type port) {
+    return crasy::endpoint(crasy::ipv4_address::loopback(), port);
+}
+
+crasy::stream<std::uint64_t> counter() {
+    for (std::uint64_t i = 0;; ++i) { co_yield std::uint64_t{i}; }
+}
+
+crasy::future<void> stream_flood(bench_clock::time_point deadline) {
+    auto values = counter();
+    while (bench_clock::now() < deadline) {
+        for (int i = 0; i < 64; ++i) { co_await values; }
+    }
+}
+
+crasy::future<void> mutex_flood(bench_clock::time_point deadline) {
+    crasy::mutex mtx;
+    std::uint64_t count = 0;
+    while (bench_clock::now() < deadline) {
+        for (int i = 0; i < 64; ++i) {
+            co_await mtx.lock();
+            ++count;
+            mtx.unlock();
+        }
+    }
+}
+
+crasy::future<void> udp_flood(bench_clock::time_point deadline) {
+    crasy::udp_socket recv_sock;
+    crasy::udp_socket send_sock;
+    if (!co_await recv_sock.bind_local(loopback(FLOOD_PORT)) ||
+        !co_await send_sock.bind_local(loopback(FLOOD_PORT + 1))) {
+        std::abort();
+    }
+    std::vector<std::byte> buf(64);
+    while (bench_clock::now() < deadline) {
+        if (!co_await send_sock.send_to(buf, loopback(FLOOD_PORT))) {
+            std::abort();
+        }
+        if (!co_await recv_sock.recv(buf)) { std::abort(); }
+    }
+}
+
+crasy::future<void> yield_flood(bench_clock::time_point deadline) {
+    std::uint64_t seed = 1;
+    while (bench_clock::now() < deadline) {
+        for (int i = 0; i < 1000; ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+        }
+        co_await crasy::yield_now();
+    }
+    if (seed == 0) { std::abort(); }
+}
+
+crasy::future<void> no_flood(bench_clock::time_point) { co_return; }
+
+// Sleeps for 1 ms over and over, recording how late each wake-up is
+crasy::future<std::vector<double>> light_task(
+    bench_clock::time_point deadline) {
+    std::vector<double> late_us;
+    while (bench_clock::now() < deadline) {
+        auto start = bench_clock::now();
+        co_await crasy::sleep_for(1ms);
+        auto late = bench_clock::now() - start - 1ms;
+        late_us.push_back(
+            std::chrono::duration<double, std::micro>(late).count());
+    }
+    co_return late_us;
+}
+
+double percentile(const std::vector<double>& sorted, double pct) {
+    if (sorted.empty()) { return 0.0; }
+    auto idx = static_cast<std::size_t>(pct / 100.0 *
+                                        static_cast<double>(sorted.size() - 1));
+    return sorted[idx];
+}
+
+template <typename F>
+void measure(crasy::local_executor& exec, const char* name,
+             std::chrono::milliseconds duration, F flood) {
+    auto late_us = exec.block_on([duration, flood] {
+        return [](auto dur, auto fl) -> crasy::future<std::vector<double>> {
+            auto deadline = bench_clock::now() + dur;
+            auto light = crasy::spawn(light_task(deadline));
+            co_await fl(deadline);
+            co_return co_await light;
+        }(duration, flood);
+    });
+    std::sort(late_us.begin(), late_us.end());
+    cell(name, 10);
+    cell(late_us.size(), 10);
+    ratio_cell(percentile(late_us, 50.0), 12);
+    ratio_cell(percentile(late_us, 99.0), 12);
+    ratio_cell(late_us.empty() ? 0.0 : late_us.back(), 12);
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto duration = std::chrono::milliseconds(arg_or(argc, argv, 1, 1000));
+
+    cell("flood", 10);
+    cell("wake-ups", 10);
+    cell("p50 us", 12);
+    cell("p99 us", 12);
+    cell("max us", 12);
+    std::cout << '\n';
+
+    crasy::local_executor exec;
+    measure(exec, "none", duration, no_flood);
+    measure(exec, "stream", duration, stream_flood);
+    measure(exec, "mutex", duration, mutex_flood);
+    measure(exec, "udp", duration, udp_flood);
+    measure(exec, "yield", duration, yield_flood);
+    return 0;
+}
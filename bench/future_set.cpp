@@ -0,0 +1,89 @@
+#include <crasy/crasy.hpp>
+#include <cstdint>
+#include <deque>
+
+#include "helpers.hpp"
+
+// Usage: future_set_bench [cores] [requests] [in_flight]
+//
+// Measures a gateway keeping a window of upstream requests outstanding,
+// starting a new one whenever one finishes. Each request is a future that
+// yields once, standing in for an I/O operation. The window is held in a
+// future_set, and the way it had to be done before: as join handles of
+// spawned requests, awaited oldest first.
+
+crasy::future<std::uint64_t> upstream(std::uint64_t value) {
+    co_await crasy::yield_now();
+    co_return value;
+}
+
+crasy::future<std::uint64_t> with_future_set(std::size_t requests,
+                                             std::size_t in_flight) {
+    std::uint64_t sum = 0;
+    std::size_t started = 0;
+    crasy::future_set<std::uint64_t> window;
+    for (; started < in_flight && started < requests; ++started) {
+        window.push(upstream(started));
+    }
+    while (auto value = co_await window.next()) {
+        sum += *value;
+        if (started < requests) { window.push(upstream(started++)); }
+    }
+    co_return sum;
+}
+
+crasy::future<std::uint64_t> with_spawn(std::size_t requests,
+                                        std::size_t in_flight) {
+    std::uint64_t sum = 0;
+    std::size_t started = 0;
+    std::deque<crasy::join_handle<std::uint64_t>> window;
+    for (; started < in_flight && started < requests; ++started) {
+        window.push_back(crasy::spawn(upstream(started)));
+    }
+    while (!window.empty()) {
+        auto oldest = std::move(window.front());
+        window.pop_front();
+        sum += co_await oldest;
+        if (started < requests) {
+            window.push_back(crasy::spawn(upstream(started++)));
+        }
+    }
+    co_return sum;
+}
+
+template <typename Exec, typename F>
+void measure(Exec& exec,
+             const char* name,
+             std::size_t requests,
+             std::size_t in_flight,
+             F load) {
+    auto start = bench_clock::now();
+    auto sum = exec.block_on(
+        [&load, requests, in_flight] { return load(requests, in_flight); });
+    auto elapsed = seconds_since(start);
+    if (sum != requests * (requests - 1) / 2) { std::abort(); }
+    cell(name, 16);
+    rate_cell(static_cast<double>(requests) / elapsed);
+    rate_cell(elapsed * 1e9 / static_cast<double>(requests));
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto cores = arg_or(argc, argv, 1, 1);
+    auto requests = arg_or(argc, argv, 2, 500000);
+    auto in_flight = arg_or(argc, argv, 3, 50000);
+
+    cell("window", 16);
+    cell("requests/s");
+    cell("ns/request");
+    std::cout << '\n';
+
+    crasy::executor exec(cores, 1);
+    measure(exec, "future_set", requests, in_flight, with_future_set);
+    measure(exec, "join handles", requests, in_flight, with_spawn);
+
+    crasy::local_executor local(1);
+    measure(local, "local: set", requests, in_flight, with_future_set);
+    measure(local, "local: handles", requests, in_flight, with_spawn);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef CRASY_BENCH_HELPERS_HPP
+#define CRASY_BENCH_HELPERS_HPP
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+// Parses a positive integer command line argument, or returns the default
+inline std::size_t arg_or(int argc,
+                          char** argv,
+                          int index,
+                          std::size_t default_value) {
+    if (index < argc) {
+        auto value = std::strtoull(argv[index], nullptr, 10);
+        if (value > 0) { return static_cast<std::size_t>(value); }
+    }
+    return default_value;
+}
+
+// Returns the number of seconds elapsed since start
+inline double seconds_since(bench_clock::time_point start) {
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// Prints a right aligned table cell
+template <typename T>
+void cell(const T& value, int width = 14) {
+    std::cout << std::setw(width) << value;
+}
+
+inline void rate_cell(double value, int width = 14) {
+    std::cout << std::setw(width) << std::fixed << std::setprecision(0)
+              << value;
+}
+
+inline void ratio_cell(double value, int width = 10) {
+    std::cout << std::setw(width) << std::fixed << std::setprecision(2)
+              << value;
+}
+
+} // namespace
+
+#endif
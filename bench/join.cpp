@@ -0,0 +1,93 @@
+#include <crasy/crasy.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Usage: join_bench [cores] [requests]
+//
+// Measures fanning a request out into FAN_OUT sub-requests and waiting for
+// all of them, the way a gateway would. Each sub-request is a future that
+// yields once, standing in for an I/O operation. The sub-requests are
+// joined with join_all, with the variadic join, and by spawning each one and
+// awaiting its join handle, which is what it took before.
+
+inline constexpr std::size_t FAN_OUT = 8;
+
+crasy::future<std::uint64_t> sub_request(std::uint64_t value) {
+    co_await crasy::yield_now();
+    co_return value;
+}
+
+crasy::future<std::uint64_t> with_join_all(std::size_t requests) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < requests; ++i) {
+        std::vector<crasy::future<std::uint64_t>> subs;
+        subs.reserve(FAN_OUT);
+        for (std::size_t j = 0; j < FAN_OUT; ++j) {
+            subs.push_back(sub_request(i));
+        }
+        for (auto value : co_await crasy::join_all(std::move(subs))) {
+            sum += value;
+        }
+    }
+    co_return sum;
+}
+
+crasy::future<std::uint64_t> with_join(std::size_t requests) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < requests; ++i) {
+        auto [a, b, c, d, e, f, g, h] = co_await crasy::join(
+            sub_request(i), sub_request(i), sub_request(i), sub_request(i),
+            sub_request(i), sub_request(i), sub_request(i), sub_request(i));
+        sum += a + b + c + d + e + f + g + h;
+    }
+    co_return sum;
+}
+
+crasy::future<std::uint64_t> with_spawn(std::size_t requests) {
+    std::uint64_t sum = 0;
+    std::vector<crasy::join_handle<std::uint64_t>> handles;
+    handles.reserve(FAN_OUT);
+    for (std::size_t i = 0; i < requests; ++i) {
+        for (std::size_t j = 0; j < FAN_OUT; ++j) {
+            handles.push_back(crasy::spawn(sub_request(i)));
+        }
+        for (auto& handle : handles) { sum += co_await handle; }
+        handles.clear();
+    }
+    co_return sum;
+}
+
+template <typename Exec, typename F>
+void measure(Exec& exec, const char* name, std::size_t requests, F load) {
+    auto start = bench_clock::now();
+    auto sum = exec.block_on([&load, requests] { return load(requests); });
+    auto elapsed = seconds_since(start);
+    if (sum != FAN_OUT * requests * (requests - 1) / 2) { std::abort(); }
+    cell(name, 16);
+    rate_cell(static_cast<double>(requests) / elapsed);
+    rate_cell(elapsed * 1e9 / static_cast<double>(requests * FAN_OUT));
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto cores = arg_or(argc, argv, 1, 1);
+    auto requests = arg_or(argc, argv, 2, 50000);
+
+    cell("fan-out", 16);
+    cell("requests/s");
+    cell("ns/sub");
+    std::cout << '\n';
+
+    crasy::executor exec(cores, 1);
+    measure(exec, "join_all", requests, with_join_all);
+    measure(exec, "join", requests, with_join);
+    measure(exec, "spawn, join", requests, with_spawn);
+
+    crasy::local_executor local(1);
+    measure(local, "local: join_all", requests, with_join_all);
+    measure(local, "local: join", requests, with_join);
+    measure(local, "local: spawn", requests, with_spawn);
+    return 0;
+}
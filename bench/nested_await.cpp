@@ -0,0 +1,64 @@
+#include <crasy/crasy.hpp>
+#include <cstdint>
+
+#include "helpers.hpp"
+
+// Usage: nested_await_bench [max_depth] [iterations]
+//
+// Measures the latency of a chain of nested co_awaits whose innermost
+// coroutine suspends once through the executor. Completion then unwinds
+// through every level of the chain, so the cost per level shows how much
+// each finishing coroutine costs its awaiter.
+
+// Builds a chain `depth` coroutines deep on top of a single suspension
+crasy::future<std::size_t> nested(std::size_t depth) {
+    if (depth == 0) {
+        // one trip through the run queue, as if waiting for I/O
+        co_await crasy::detail::schedule_awaiter{};
+        co_return 0;
+    }
+    co_return co_await nested(depth - 1) + 1;
+}
+
+crasy::future<std::uint64_t> run_chains(std::size_t depth,
+                                        std::size_t iterations) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < iterations; ++i) {
+        sum += co_await nested(depth);
+    }
+    co_return sum;
+}
+
+int main(int argc, char** argv) {
+    auto max_depth = arg_or(argc, argv, 1, 256);
+    auto iterations = arg_or(argc, argv, 2, 20000);
+
+    cell("depth", 6);
+    cell("ns/chain");
+    cell("ns/level");
+    std::cout << '\n';
+
+    crasy::executor exec(1, 1);
+    double base = 0;
+    for (std::size_t depth = 0; depth <= max_depth;
+         depth = depth == 0 ? 1 : depth * 2) {
+        auto start = bench_clock::now();
+        auto sum = exec.block_on([depth, iterations] {
+            return run_chains(depth, iterations);
+        });
+        auto elapsed = seconds_since(start);
+        if (sum != depth * iterations) { std::abort(); }
+
+        auto per_chain = elapsed * 1e9 / static_cast<double>(iterations);
+        if (depth == 0) { base = per_chain; }
+        cell(depth, 6);
+        rate_cell(per_chain);
+        if (depth == 0) {
+            cell("-");
+        } else {
+            rate_cell((per_chain - base) / static_cast<double>(depth));
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <chrono>
+#include <crasy/crasy.hpp>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Usage: park_latency_bench [cores] [round trips]
+//
+// Measures how long an idle executor takes to resume a task once a blocking
+// thread wakes it, under different park policies. Each round trip sleeps
+// for 50 us on a blocking thread, so the core threads run out of work and
+// go idle in the meantime. Alongside the wake-up latency, the table shows
+// how the threads went idle, and how much CPU time the process used.
+
+using namespace std::chrono_literals;
+
+crasy::future<std::vector<double>> round_trips(std::size_t count) {
+    std::vector<double> wake_us;
+    wake_us.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto sent = co_await crasy::spawn_blocking([] {
+            std::this_thread::sleep_for(50us);
+            return bench_clock::now();
+        });
+        wake_us.push_back(std::chrono::duration<double, std::micro>(
+                              bench_clock::now() - sent)
+                              .count());
+    }
+    co_return wake_us;
+}
+
+double percentile(const std::vector<double>& sorted, double pct) {
+    if (sorted.empty()) { return 0.0; }
+    auto idx = static_cast<std::size_t>(pct / 100.0 *
+                                        static_cast<double>(sorted.size() - 1));
+    return sorted[idx];
+}
+
+void measure(const char* name, std::size_t cores, std::size_t count,
+             crasy::park_policy parking) {
+    crasy::executor exec(cores, crasy::executor::DEFAULT_MAX_BLOCKING_THREADS,
+                         crasy::executor_mode::work_stealing, parking);
+    auto cpu_start = std::clock();
+    auto start = bench_clock::now();
+    auto wake_us = exec.block_on([count] { return round_trips(count); });
+    auto elapsed = seconds_since(start);
+    auto cpu = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    auto stats = exec.parking_stats();
+
+    std::sort(wake_us.begin(), wake_us.end());
+    cell(name, 12);
+    ratio_cell(percentile(wake_us, 50.0), 10);
+    ratio_cell(percentile(wake_us, 99.0), 10);
+    cell(stats.idle, 10);
+    cell(stats.spin_hits, 10);
+    cell(stats.parks, 10);
+    cell(stats.unparks, 10);
+    ratio_cell(cpu / elapsed, 10);
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto cores = arg_or(argc, argv, 1, 1);
+    auto count = arg_or(argc, argv, 2, 5000);
+
+    cell("policy", 12);
+    cell("p50 us", 10);
+    cell("p99 us", 10);
+    cell("idle", 10);
+    cell("spin hits", 10);
+    cell("parks", 10);
+    cell("unparks", 10);
+    cell("cpu/wall", 10);
+    std::cout << '\n';
+
+    measure("park", cores, count, crasy::park_policy::park_immediately());
+    measure("spin 100us", cores, count, crasy::park_policy{100us, 0us});
+    measure("yield 100us", cores, count, crasy::park_policy{0us, 100us});
+    measure("busy poll", cores, count, crasy::park_policy::busy_poll());
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <chrono>
+#include <crasy/crasy.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Usage: priority_latency_bench [milliseconds] [bulk tasks]
+//
+// Measures how late heartbeat tasks wake at each 1 ms tick while the
+// executor is saturated with bulk tasks, which each burn a few microseconds
+// of CPU and yield, over and over. Two heartbeats run side by side, due at
+// the same instants: one with the same priority as the bulk tasks, and one
+// as priority::critical.
+
+using namespace std::chrono_literals;
+
+crasy::future<void> bulk_task(bench_clock::time_point deadline) {
+    std::uint64_t seed = 1;
+    while (bench_clock::now() < deadline) {
+        for (int i = 0; i < 2000; ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+        }
+        co_await crasy::yield_now();
+    }
+    if (seed == 0) { std::abort(); }
+}
+
+// Wakes at every 1 ms tick from `start` on, recording how late each wake-up
+// is. Heartbeats that share `start` are due at the same instants.
+crasy::future<std::vector<double>> heartbeat(bench_clock::time_point start,
+                                             bench_clock::time_point deadline) {
+    std::vector<double> late_us;
+    for (auto tick = start + 1ms; tick < deadline; tick += 1ms) {
+        co_await crasy::sleep_until(tick);
+        auto late = bench_clock::now() - tick;
+        late_us.push_back(
+            std::chrono::duration<double, std::micro>(late).count());
+    }
+    co_return late_us;
+}
+
+double percentile(const std::vector<double>& sorted, double pct) {
+    if (sorted.empty()) { return 0.0; }
+    auto idx = static_cast<std::size_t>(pct / 100.0 *
+                                        static_cast<double>(sorted.size() - 1));
+    return sorted[idx];
+}
+
+void row(const char* name, const char* prio, std::vector<double> late_us) {
+    std::sort(late_us.begin(), late_us.end());
+    cell(name, 10);
+    cell(prio, 10);
+    cell(late_us.size(), 10);
+    ratio_cell(percentile(late_us, 50.0), 12);
+    ratio_cell(percentile(late_us, 99.0), 12);
+    ratio_cell(late_us.empty() ? 0.0 : late_us.back(), 12);
+    std::cout << std::endl;
+}
+
+template <typename Exec>
+void measure(Exec& exec, const char* name, std::chrono::milliseconds duration,
+             std::size_t bulk) {
+    auto [normal, critical] = exec.block_on([=] {
+        return [](auto dur, auto count)
+                   -> crasy::future<std::pair<std::vector<double>,
+                                              std::vector<double>>> {
+            auto start = bench_clock::now();
+            auto deadline = start + dur;
+            std::vector<crasy::join_handle<void>> bulk_tasks;
+            bulk_tasks.reserve(count);
+            for (std::size_t i = 0; i < count; ++i) {
+                bulk_tasks.push_back(
+                    crasy::spawn([deadline] { return bulk_task(deadline); }));
+            }
+            auto beat = [start, deadline] {
+                return heartbeat(start, deadline);
+            };
+            auto normal_beat = crasy::spawn(crasy::priority::normal, beat);
+            auto critical_beat = crasy::spawn(crasy::priority::critical, beat);
+            for (auto& task : bulk_tasks) { co_await task; }
+            auto normal_late = co_await normal_beat;
+            co_return std::pair{std::move(normal_late),
+                                co_await critical_beat};
+        }(duration, bulk);
+    });
+    row(name, "normal", std::move(normal));
+    row(name, "critical", std::move(critical));
+}
+
+int main(int argc, char** argv) {
+    auto duration = std::chrono::milliseconds(arg_or(argc, argv, 1, 1000));
+    auto bulk = arg_or(argc, argv, 2, 1000);
+
+    cell("executor", 10);
+    cell("heartbeat", 10);
+    cell("wake-ups", 10);
+    cell("p50 us", 12);
+    cell("p99 us", 12);
+    cell("max us", 12);
+    std::cout << '\n';
+
+    {
+        crasy::local_executor exec;
+        measure(exec, "local", duration, bulk);
+    }
+    {
+        crasy::executor exec;
+        measure(exec, "stealing", duration, bulk);
+    }
+    {
+        crasy::executor exec(*crasy::available_cpu_cores(),
+                             crasy::executor::DEFAULT_MAX_BLOCKING_THREADS,
+                             crasy::executor_mode::sharded);
+        measure(exec, "sharded", duration, bulk);
+    }
+    return 0;
+}
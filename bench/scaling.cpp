@@ -0,0 +1,150 @@
+#include <crasy/crasy.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Usage: scaling_bench [max_cores] [tasks] [socket_pairs] [round_trips]
+//                      [sharded]
+//
+// Runs the same spawn-heavy and I/O-heavy loads on executors with 1..N core
+// threads and reports throughput along with the speedup over one core. If
+// `sharded` is non-zero, the executors run in sharded mode and the socket
+// pairs are spread over the shards.
+
+// First port used by the I/O load. Each socket pair uses two ports.
+inline constexpr crasy::port_type BASE_PORT = 42000;
+
+// A small amount of CPU work so that each task is more than a context switch
+std::uint64_t spin_work(std::uint64_t seed) {
+    for (int i = 0; i < 2000; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+    }
+    return seed;
+}
+
+// Spawns `tasks` short-lived tasks and waits for all of them
+crasy::future<std::uint64_t> spawn_load(std::size_t tasks) {
+    std::vector<crasy::join_handle<std::uint64_t>> handles;
+    handles.reserve(tasks);
+    for (std::size_t i = 0; i < tasks; ++i) {
+        handles.push_back(crasy::spawn([i] { return spin_work(i + 1); }));
+    }
+    std::uint64_t sum = 0;
+    for (auto& handle : handles) { sum += co_await handle; }
+    co_return sum;
+}
+
+crasy::endpoint loopback(crasy::port_type port) {
+    return crasy::endpoint(crasy::ipv4_address::loopback(), port);
+}
+
+// Echoes `round_trips` datagrams back to the sender
+crasy::future<void> echo_peer(crasy::udp_socket& sock,
+                              std::size_t round_trips) {
+    std::vector<std::byte> buf(64);
+    for (std::size_t i = 0; i < round_trips; ++i) {
+        crasy::endpoint peer = loopback(0);
+        auto len = co_await sock.recv_from(buf, peer);
+        if (!len) { std::abort(); }
+        buf.resize(len.ok());
+        if (!co_await sock.send_to(buf, peer)) { std::abort(); }
+        buf.resize(64);
+    }
+}
+
+// Sends `round_trips` datagrams to the echo peer, one at a time
+crasy::future<void> ping_peer(crasy::udp_socket& sock,
+                              crasy::endpoint peer,
+                              std::size_t round_trips) {
+    std::vector<std::byte> buf(32, std::byte{0x5a});
+    for (std::size_t i = 0; i < round_trips; ++i) {
+        if (!co_await sock.send_to(buf, peer)) { std::abort(); }
+        crasy::endpoint from = loopback(0);
+        if (!co_await sock.recv_from(buf, from)) { std::abort(); }
+    }
+}
+
+// Runs one UDP ping-pong session over loopback, on the caller's shard
+crasy::future<void> io_pair(std::size_t index, std::size_t round_trips) {
+    crasy::udp_socket ping;
+    crasy::udp_socket echo;
+    auto ping_port = static_cast<crasy::port_type>(BASE_PORT + 2 * index);
+    auto echo_port = static_cast<crasy::port_type>(ping_port + 1);
+    if (!co_await ping.bind_local(loopback(ping_port)) ||
+        !co_await echo.bind_local(loopback(echo_port))) {
+        std::abort();
+    }
+    auto echo_task = crasy::spawn(echo_peer(echo, round_trips));
+    auto ping_task =
+        crasy::spawn(ping_peer(ping, loopback(echo_port), round_trips));
+    co_await echo_task;
+    co_await ping_task;
+}
+
+// Runs `pairs` independent UDP ping-pong sessions, spread over the shards
+crasy::future<void> io_load(std::size_t pairs, std::size_t round_trips) {
+    std::vector<crasy::join_handle<void>> handles;
+    handles.reserve(pairs);
+    for (std::size_t i = 0; i < pairs; ++i) {
+        handles.push_back(
+            crasy::spawn_on(i % crasy::shard_count(), [i, round_trips] {
+                return io_pair(i, round_trips);
+            }));
+    }
+    for (auto& handle : handles) { co_await handle; }
+}
+
+int main(int argc, char** argv) {
+    auto max_cores = arg_or(argc, argv, 1, *crasy::available_cpu_cores());
+    auto tasks = arg_or(argc, argv, 2, 200000);
+    auto pairs = arg_or(argc, argv, 3, 64);
+    auto round_trips = arg_or(argc, argv, 4, 2000);
+    auto mode = arg_or(argc, argv, 5, 0) != 0 ?
+                    crasy::executor_mode::sharded :
+                    crasy::executor_mode::work_stealing;
+
+    cell("cores", 6);
+    cell("spawn/s");
+    cell("speedup", 10);
+    cell("msgs/s");
+    cell("speedup", 10);
+    std::cout << '\n';
+
+    double spawn_base = 0;
+    double io_base = 0;
+    for (std::size_t cores = 1; cores <= max_cores; ++cores) {
+        crasy::executor exec(cores, 1, mode);
+
+        auto start = bench_clock::now();
+        exec.block_on([tasks] { return spawn_load(tasks); });
+        auto spawn_rate = static_cast<double>(tasks) / seconds_since(start);
+
+        start = bench_clock::now();
+        exec.block_on([pairs, round_trips] {
+            return io_load(pairs, round_trips);
+        });
+        auto io_rate = static_cast<double>(pairs * round_trips * 2) /
+                       seconds_since(start);
+
+        if (cores == 1) {
+            spawn_base = spawn_rate;
+            io_base = io_rate;
+        }
+        cell(cores, 6);
+        rate_cell(spawn_rate);
+        ratio_cell(spawn_rate / spawn_base);
+        rate_cell(io_rate);
+        ratio_cell(io_rate / io_base);
+        std::cout << std::endl;
+    }
+
+    auto frames = crasy::frame_pool_statistics();
+    std::cout << "\nframe pool: " << frames.allocations << " allocations, "
+              << std::setprecision(1) << frames.hit_rate() * 100.0
+              << "% hits, " << frames.remote_frees << " remote frees, "
+              << frames.oversized << " oversized" << std::endl;
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <chrono>
+#include <crasy/crasy.hpp>
+#include <cstdint>
+#include <stop_token>
+#include <variant>
+
+#include "helpers.hpp"
+
+// Usage: select_bench [cores] [events]
+//
+// Measures an event loop that waits on a read, a shutdown signal that never
+// comes, and an idle timer, the read always winning. Each read is a future
+// that yields once, standing in for an I/O operation. The branches are raced
+// with crasy::select, and by hand the way it had to be done before: spawning
+// a task per branch and stopping the losers once the read is in.
+
+using namespace std::chrono_literals;
+
+inline constexpr auto IDLE = 1s;
+
+crasy::future<std::uint64_t> read(std::uint64_t value) {
+    co_await crasy::yield_now();
+    co_return value;
+}
+
+crasy::future<void> shutdown_signal(std::stop_token stop) {
+    co_await crasy::sleep_for(24h, stop);
+}
+
+crasy::future<std::uint64_t> with_select(std::size_t events) {
+    std::uint64_t sum = 0;
+    std::stop_source never;
+    for (std::size_t i = 0; i < events; ++i) {
+        auto res = co_await crasy::select(read(i),
+                                          shutdown_signal(never.get_token()),
+                                          crasy::sleep_for(IDLE));
+        if (res.index() != 0) { std::abort(); }
+        sum += std::get<0>(res);
+    }
+    co_return sum;
+}
+
+crasy::future<std::uint64_t> with_spawn(std::size_t events) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < events; ++i) {
+        std::stop_source stop;
+        auto shutdown = crasy::spawn(shutdown_signal(stop.get_token()));
+        auto idle = crasy::spawn(crasy::sleep_for(IDLE, stop.get_token()));
+        sum += co_await crasy::spawn(read(i));
+        stop.request_stop();
+        co_await shutdown;
+        co_await idle;
+    }
+    co_return sum;
+}
+
+template <typename Exec, typename F>
+void measure(Exec& exec, const char* name, std::size_t events, F load) {
+    auto start = bench_clock::now();
+    auto sum = exec.block_on([&load, events] { return load(events); });
+    auto elapsed = seconds_since(start);
+    if (sum != events * (events - 1) / 2) { std::abort(); }
+    cell(name, 16);
+    rate_cell(static_cast<double>(events) / elapsed);
+    rate_cell(elapsed * 1e9 / static_cast<double>(events));
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto cores = arg_or(argc, argv, 1, 1);
+    auto events = arg_or(argc, argv, 2, 100000);
+
+    cell("race", 16);
+    cell("events/s");
+    cell("ns/event");
+    std::cout << '\n';
+
+    crasy::executor exec(cores, 1);
+    measure(exec, "select", events, with_select);
+    measure(exec, "spawned branches", events, with_spawn);
+
+    crasy::local_executor local(1);
+    measure(local, "local: select", events, with_select);
+    measure(local, "local: spawn", events, with_spawn);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <chrono>
+#include <crasy/crasy.hpp>
+#include <ctime>
+#include <random>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Usage: sleep_jitter_bench [sleeps]
+//
+// Measures how far from their deadlines sleeps of 10 to 500 us end, with
+// sleep_for and with precise_sleep_for, on a local executor and on a
+// sharded one, which is run both as is and with the kernel's timer slack
+// cut by executor::builder::precise_timer_slack. The error is how late the
+// sleeping task resumes; neither kind of sleep ever ends early. The table
+// also shows the CPU time used per sleep, which for precise sleeps includes
+// the spinning.
+
+using namespace std::chrono_literals;
+
+template <bool Precise>
+crasy::future<std::vector<double>> sleeps(std::size_t count) {
+    std::mt19937 rng{7};
+    std::uniform_int_distribution<int> delay_us{10, 500};
+    std::vector<double> error_us;
+    error_us.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto delay = std::chrono::microseconds(delay_us(rng));
+        auto deadline = bench_clock::now() + delay;
+        if constexpr (Precise) {
+            co_await crasy::precise_sleep_until(deadline);
+        } else {
+            co_await crasy::sleep_until(deadline);
+        }
+        error_us.push_back(std::chrono::duration<double, std::micro>(
+                               bench_clock::now() - deadline)
+                               .count());
+    }
+    co_return error_us;
+}
+
+double percentile(const std::vector<double>& sorted, double pct) {
+    if (sorted.empty()) { return 0.0; }
+    auto idx = static_cast<std::size_t>(pct / 100.0 *
+                                        static_cast<double>(sorted.size() - 1));
+    return sorted[idx];
+}
+
+template <bool Precise, typename Exec>
+void measure(Exec& exec, const char* name, std::size_t count) {
+    auto cpu_start = std::clock();
+    auto error_us = exec.block_on([count] { return sleeps<Precise>(count); });
+    auto cpu_us = static_cast<double>(std::clock() - cpu_start) * 1e6 /
+                  CLOCKS_PER_SEC / static_cast<double>(count);
+    std::sort(error_us.begin(), error_us.end());
+    cell(name, 10);
+    cell(Precise ? "precise" : "sleep_for", 11);
+    ratio_cell(percentile(error_us, 50.0), 10);
+    ratio_cell(percentile(error_us, 99.0), 10);
+    ratio_cell(error_us.empty() ? 0.0 : error_us.back(), 10);
+    ratio_cell(cpu_us, 12);
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto count = arg_or(argc, argv, 1, 5000);
+
+    cell("executor", 10);
+    cell("sleep", 11);
+    cell("p50 us", 10);
+    cell("p99 us", 10);
+    cell("max us", 10);
+    cell("cpu us/op", 12);
+    std::cout << '\n';
+
+    {
+        crasy::local_executor exec;
+        measure<false>(exec, "local", count);
+        measure<true>(exec, "local", count);
+    }
+    {
+        crasy::executor exec(1, crasy::executor::DEFAULT_MAX_BLOCKING_THREADS,
+                             crasy::executor_mode::sharded);
+        measure<false>(exec, "sharded", count);
+        measure<true>(exec, "sharded", count);
+    }
+    {
+        auto exec = crasy::executor::builder()
+                        .core_threads(1)
+                        .mode(crasy::executor_mode::sharded)
+                        .precise_timer_slack(true)
+                        .build();
+        measure<false>(exec, "1ns slack", count);
+        measure<true>(exec, "1ns slack", count);
+    }
+    return 0;
+}
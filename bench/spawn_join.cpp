@@ -0,0 +1,138 @@
+#include <atomic>
+#include <crasy/crasy.hpp>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Usage: spawn_join_bench [cores] [tasks]
+//
+// Measures the throughput of spawning trivial tasks and joining them, both
+// one at a time and in batches, for async and blocking tasks, as well as of
+// spawning detached tasks, and of round trips through block_on. The async
+// loads are repeated on a local_executor. The tasks do no work, so the
+// numbers are dominated by the cost of the join handles.
+
+// Number of tasks spawned before any of them is joined, in batch mode
+inline constexpr std::size_t BATCH = 256;
+
+crasy::future<std::uint64_t> trivial(std::uint64_t value) {
+    co_return value;
+}
+
+crasy::future<std::uint64_t> spawn_each(std::size_t tasks) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < tasks; ++i) {
+        sum += co_await crasy::spawn(trivial(i));
+    }
+    co_return sum;
+}
+
+crasy::future<std::uint64_t> spawn_batch(std::size_t tasks) {
+    std::uint64_t sum = 0;
+    std::vector<crasy::join_handle<std::uint64_t>> handles;
+    handles.reserve(BATCH);
+    for (std::size_t i = 0; i < tasks; i += BATCH) {
+        for (std::size_t j = i; j < i + BATCH && j < tasks; ++j) {
+            handles.push_back(crasy::spawn([j] { return trivial(j); }));
+        }
+        for (auto& handle : handles) { sum += co_await handle; }
+        handles.clear();
+    }
+    co_return sum;
+}
+
+crasy::future<void> add_to(std::atomic<std::uint64_t>& sum,
+                          std::atomic<std::size_t>& remaining,
+                          std::uint64_t value) {
+    sum.fetch_add(value, std::memory_order_relaxed);
+    remaining.fetch_sub(1, std::memory_order_release);
+    co_return;
+}
+
+crasy::future<std::uint64_t> spawn_detached_each(std::size_t tasks) {
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::size_t> remaining{tasks};
+    for (std::size_t i = 0; i < tasks; ++i) {
+        crasy::spawn_detached(add_to(sum, remaining, i));
+    }
+    // the tasks never suspend, so they have all finished by now
+    if (remaining.load(std::memory_order_acquire) != 0) { std::abort(); }
+    co_return sum.load();
+}
+
+crasy::future<std::uint64_t> spawn_blocking_each(std::size_t tasks) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < tasks; ++i) {
+        sum += co_await crasy::spawn_blocking([i] { return std::uint64_t{i}; });
+    }
+    co_return sum;
+}
+
+crasy::future<std::uint64_t> spawn_blocking_batch(std::size_t tasks) {
+    std::uint64_t sum = 0;
+    std::vector<std::function<std::uint64_t()>> funcs;
+    funcs.reserve(BATCH);
+    for (std::size_t i = 0; i < tasks; i += BATCH) {
+        for (std::size_t j = i; j < i + BATCH && j < tasks; ++j) {
+            funcs.emplace_back([j] { return std::uint64_t{j}; });
+        }
+        for (auto& handle : crasy::spawn_blocking_batch(std::move(funcs))) {
+            sum += co_await handle;
+        }
+        funcs.clear();
+    }
+    co_return sum;
+}
+
+// Round trips through block_on, each running a single trivial future
+template <typename Exec>
+void measure_block_on(Exec& exec, const char* name, std::size_t calls) {
+    std::uint64_t sum = 0;
+    auto start = bench_clock::now();
+    for (std::size_t i = 0; i < calls; ++i) {
+        sum += exec.block_on([i] { return trivial(i); });
+    }
+    auto elapsed = seconds_since(start);
+    if (sum != calls * (calls - 1) / 2) { std::abort(); }
+    cell(name, 16);
+    rate_cell(static_cast<double>(calls) / elapsed);
+    std::cout << std::endl;
+}
+
+template <typename Exec, typename F>
+void measure(Exec& exec, const char* name, std::size_t tasks, F load) {
+    auto start = bench_clock::now();
+    auto sum = exec.block_on([&load, tasks] { return load(tasks); });
+    auto elapsed = seconds_since(start);
+    if (sum != tasks * (tasks - 1) / 2) { std::abort(); }
+    cell(name, 16);
+    rate_cell(static_cast<double>(tasks) / elapsed);
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto cores = arg_or(argc, argv, 1, 1);
+    auto tasks = arg_or(argc, argv, 2, 200000);
+
+    cell("load", 16);
+    cell("tasks/s");
+    std::cout << '\n';
+
+    crasy::executor exec(cores, 1);
+    measure(exec, "spawn, join", tasks, spawn_each);
+    measure(exec, "spawn batch", tasks, spawn_batch);
+    measure(exec, "spawn detached", tasks, spawn_detached_each);
+    measure(exec, "blocking, join", tasks / 4, spawn_blocking_each);
+    measure(exec, "blocking batch", tasks / 4, spawn_blocking_batch);
+    measure_block_on(exec, "block_on", tasks / 4);
+
+    // the same loads on the calling thread alone
+    crasy::local_executor local(1);
+    measure(local, "local: spawn", tasks, spawn_each);
+    measure(local, "local: batch", tasks, spawn_batch);
+    measure(local, "local: detached", tasks, spawn_detached_each);
+    measure_block_on(local, "local: block_on", tasks / 4);
+    return 0;
+}
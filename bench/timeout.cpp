@@ -0,0 +1,88 @@
+#include <chrono>
+#include <crasy/crasy.hpp>
+#include <cstdint>
+#include <stop_token>
+
+#include "helpers.hpp"
+
+// Usage: timeout_bench [cores] [requests]
+//
+// Measures the cost of putting a deadline on an operation that beats it,
+// which is the common case on a request/response path. Each request is a
+// future that yields once, standing in for an I/O operation, and is awaited
+// with no deadline, through crasy::timeout, and by hand the way it had to be
+// done before: spawning the request and a watchdog sleep as separate tasks,
+// joining the request, then stopping and joining the watchdog.
+
+using namespace std::chrono_literals;
+
+inline constexpr auto DEADLINE = 1s;
+
+crasy::future<std::uint64_t> request(std::uint64_t value) {
+    co_await crasy::yield_now();
+    co_return value;
+}
+
+crasy::future<std::uint64_t> plain(std::size_t requests) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < requests; ++i) {
+        sum += co_await request(i);
+    }
+    co_return sum;
+}
+
+crasy::future<std::uint64_t> with_timeout(std::size_t requests) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < requests; ++i) {
+        auto res = co_await crasy::timeout(DEADLINE, request(i));
+        if (!res) { std::abort(); }
+        sum += res.ok();
+    }
+    co_return sum;
+}
+
+crasy::future<std::uint64_t> with_watchdog(std::size_t requests) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < requests; ++i) {
+        std::stop_source stop;
+        auto watchdog =
+            crasy::spawn(crasy::sleep_for(DEADLINE, stop.get_token()));
+        sum += co_await crasy::spawn(request(i));
+        stop.request_stop();
+        co_await watchdog;
+    }
+    co_return sum;
+}
+
+template <typename Exec, typename F>
+void measure(Exec& exec, const char* name, std::size_t requests, F load) {
+    auto start = bench_clock::now();
+    auto sum = exec.block_on([&load, requests] { return load(requests); });
+    auto elapsed = seconds_since(start);
+    if (sum != requests * (requests - 1) / 2) { std::abort(); }
+    cell(name, 18);
+    rate_cell(static_cast<double>(requests) / elapsed);
+    rate_cell(elapsed * 1e9 / static_cast<double>(requests));
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto cores = arg_or(argc, argv, 1, 1);
+    auto requests = arg_or(argc, argv, 2, 200000);
+
+    cell("deadline", 18);
+    cell("requests/s");
+    cell("ns/request");
+    std::cout << '\n';
+
+    crasy::executor exec(cores, 1);
+    measure(exec, "none", requests, plain);
+    measure(exec, "timeout", requests, with_timeout);
+    measure(exec, "spawned watchdog", requests, with_watchdog);
+
+    crasy::local_executor local(1);
+    measure(local, "local: none", requests, plain);
+    measure(local, "local: timeout", requests, with_timeout);
+    measure(local, "local: watchdog", requests, with_watchdog);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <chrono>
+#include <crasy/crasy.hpp>
+#include <ctime>
+#include <random>
+#include <sys/resource.h>
+#include <vector>
+
+#include "helpers.hpp"
+
+// Usage: timer_slack_bench [tasks] [milliseconds]
+//
+// Runs many periodic housekeeping tasks, which each sleep for 10 to 20 ms
+// over and over and do nothing else, under different default timer slacks.
+// The table shows how many times the process was switched out voluntarily,
+// which is roughly how often the executor's threads woke up, the CPU time
+// it used, and how late the timers fired on average.
+
+using namespace std::chrono_literals;
+
+crasy::future<double> housekeeping(std::uint32_t seed,
+                                   bench_clock::time_point deadline) {
+    std::minstd_rand rng{seed};
+    std::uniform_int_distribution<int> period_us{10000, 20000};
+    double late_us = 0.0;
+    std::size_t wakeups = 0;
+    while (bench_clock::now() < deadline) {
+        auto period = std::chrono::microseconds(period_us(rng));
+        auto start = bench_clock::now();
+        co_await crasy::sleep_for(period);
+        late_us += std::chrono::duration<double, std::micro>(
+                       bench_clock::now() - start - period)
+                       .count();
+        ++wakeups;
+    }
+    co_return wakeups == 0 ? 0.0 : late_us / static_cast<double>(wakeups);
+}
+
+crasy::future<double> run_tasks(std::size_t count,
+                                std::chrono::milliseconds duration) {
+    auto deadline = bench_clock::now() + duration;
+    std::vector<crasy::join_handle<double>> tasks;
+    tasks.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        tasks.push_back(crasy::spawn([i, deadline] {
+            return housekeeping(static_cast<std::uint32_t>(i) + 1, deadline);
+        }));
+    }
+    double late_us = 0.0;
+    for (auto& task : tasks) { late_us += co_await task; }
+    co_return late_us / static_cast<double>(count);
+}
+
+long context_switches() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw;
+}
+
+template <typename Exec>
+void measure(Exec& exec, const char* name, std::chrono::microseconds slack,
+             std::size_t count, std::chrono::milliseconds duration) {
+    exec.set_timer_slack(slack);
+    auto switches = context_switches();
+    auto cpu_start = std::clock();
+    auto late_us = exec.block_on(
+        [count, duration] { return run_tasks(count, duration); });
+    auto cpu_ms =
+        static_cast<double>(std::clock() - cpu_start) * 1000.0 / CLOCKS_PER_SEC;
+    cell(name, 10);
+    cell(slack.count(), 10);
+    cell(context_switches() - switches, 12);
+    ratio_cell(cpu_ms, 12);
+    ratio_cell(late_us, 12);
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto count = arg_or(argc, argv, 1, 10000);
+    auto duration = std::chrono::milliseconds(arg_or(argc, argv, 2, 2000));
+
+    cell("executor", 10);
+    cell("slack us", 10);
+    cell("switches", 12);
+    cell("cpu ms", 12);
+    cell("late us", 12);
+    std::cout << '\n';
+
+    for (auto slack : {0us, 100us, 1000us, 5000us}) {
+        crasy::local_executor exec;
+        measure(exec, "local", slack, count, duration);
+    }
+    for (auto slack : {0us, 100us, 1000us, 5000us}) {
+        crasy::executor exec;
+        measure(exec, "stealing", slack, count, duration);
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <chrono>
+#include <coroutine>
+#include <crasy/crasy.hpp>
+#include <ctime>
+#include <memory>
+#include <random>
+#include <vector>
+
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wuseless-cast"
+#pragma GCC diagnostic ignored "-Wconversion"
+#endif
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+#include "helpers.hpp"
+
+// Usage: timers_bench [timers]
+//
+// Compares the executor's timing wheel with a timer heap, which is how asio
+// keeps its timers, with a million timers outstanding at once. Each run arms
+// every timer, with deadlines spread at random over the next 1 to 10
+// seconds, and then either cancels them all, or arms them over the next
+// 100 ms and lets them all fire. Arming and cancelling are timed per timer;
+// firing is measured as the CPU time used until the last timer fires, since
+// the wall time is set by the deadlines.
+//
+// The heap runs on an io_context with a single thread, as a local executor
+// does; the wheel's timers wake a no-op coroutine, so that neither side pays
+// for running tasks.
+
+using namespace std::chrono_literals;
+
+using sleep_type = decltype(crasy::sleep_for(1ms));
+
+std::vector<std::chrono::microseconds> random_delays(
+    std::size_t count, std::chrono::milliseconds min,
+    std::chrono::milliseconds max) {
+    std::mt19937_64 rng{42};
+    std::uniform_int_distribution<std::int64_t> dist{
+        std::chrono::microseconds(min).count(),
+        std::chrono::microseconds(max).count()};
+    std::vector<std::chrono::microseconds> delays;
+    delays.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        delays.emplace_back(dist(rng));
+    }
+    return delays;
+}
+
+double ns_per(bench_clock::time_point start, std::size_t count) {
+    return seconds_since(start) * 1e9 / static_cast<double>(count);
+}
+
+double cpu_ms_since(std::clock_t start) {
+    return static_cast<double>(std::clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+void row(const char* name, double arm_ns, double cancel_ns, double fire_ms) {
+    cell(name, 8);
+    ratio_cell(arm_ns, 12);
+    ratio_cell(cancel_ns, 12);
+    ratio_cell(fire_ms, 14);
+    std::cout << std::endl;
+}
+
+void measure_heap(std::size_t count) {
+    asio::io_context context{1};
+    std::vector<asio::steady_timer> timers;
+    timers.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) { timers.emplace_back(context); }
+    std::size_t fired = 0;
+    auto on_fire = [&fired](auto) { ++fired; };
+
+    auto delays = random_delays(count, 1s, 10s);
+    auto start = bench_clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+        timers[i].expires_after(delays[i]);
+        timers[i].async_wait(on_fire);
+    }
+    auto arm_ns = ns_per(start, count);
+    start = bench_clock::now();
+    for (auto& timer : timers) { timer.cancel(); }
+    // the cancelled handlers still have to run
+    context.run();
+    auto cancel_ns = ns_per(start, count);
+
+    delays = random_delays(count, 0ms, 100ms);
+    context.restart();
+    for (std::size_t i = 0; i < count; ++i) {
+        timers[i].expires_after(delays[i]);
+        timers[i].async_wait(on_fire);
+    }
+    auto cpu_start = std::clock();
+    context.run();
+    row("heap", arm_ns, cancel_ns, cpu_ms_since(cpu_start));
+}
+
+crasy::future<void> wheel_runs(std::size_t count) {
+    std::allocator<sleep_type> alloc;
+    auto* timers = alloc.allocate(count);
+    auto make = [&](const std::vector<std::chrono::microseconds>& delays) {
+        for (std::size_t i = 0; i < count; ++i) {
+            ::new (static_cast<void*>(timers + i))
+                sleep_type(crasy::sleep_for(delays[i]));
+        }
+    };
+    auto destroy = [&] {
+        for (std::size_t i = 0; i < count; ++i) { timers[i].~sleep_type(); }
+    };
+
+    make(random_delays(count, 1s, 10s));
+    auto start = bench_clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+        timers[i].await_suspend(std::noop_coroutine());
+    }
+    auto arm_ns = ns_per(start, count);
+    start = bench_clock::now();
+    // destroying a timer that has not fired cancels it
+    destroy();
+    auto cancel_ns = ns_per(start, count);
+
+    make(random_delays(count, 0ms, 100ms));
+    for (std::size_t i = 0; i < count; ++i) {
+        timers[i].await_suspend(std::noop_coroutine());
+    }
+    auto cpu_start = std::clock();
+    // due after every other timer
+    co_await crasy::sleep_for(101ms);
+    auto fire_ms = cpu_ms_since(cpu_start);
+    destroy();
+    alloc.deallocate(timers, count);
+    row("wheel", arm_ns, cancel_ns, fire_ms);
+}
+
+int main(int argc, char** argv) {
+    auto count = arg_or(argc, argv, 1, 1000000);
+
+    cell("timers", 8);
+    cell("arm ns", 12);
+    cell("cancel ns", 12);
+    cell("fire cpu ms", 14);
+    std::cout << '\n';
+
+    measure_heap(count);
+    crasy::local_executor exec;
+    exec.block_on([count] { return wheel_runs(count); });
+    return 0;
+}
@@ -3,7 +3,9 @@ config_option(WERROR BOOL "Treat all crasy compiler warnings as errors" ${DEVEL}
 config_option(ENABLE_CLANG_FORMAT BOOL "Enable crasy code formatting with clang-format" ${DEVEL})
 config_option(BUILD_STATIC BOOL "Build crasy as a static library" OFF)
 config_option(ENABLE_SSL BOOL "Enable SSL/TLS support" ON)
+config_option(ENABLE_FRAME_POOL BOOL "Allocate coroutine frames from per-thread pools" ON)
 config_option(BUILD_EXAMPLES BOOL "Build crasy examples" ${DEVEL})
+config_option(BUILD_BENCHMARKS BOOL "Build crasy benchmarks" OFF)
 
 config_option(OUTPUT_DIR STRING "Output directory for crasy compile binaries and generated files" "${PROJECT_BINARY_DIR}/output")
 
@@ -35,35 +35,42 @@ crasy::future<int> async_main() {
         co_return err.value();
     }
 
-    // Listen loop
-    for (;;) {
-        remote_endpoint = crasy::endpoint(); // Reset remote endpoint
+    // Listen loop - The echo tasks are spawned within a task scope, which
+    // waits for all of them before returning, so they can borrow the socket
+    // from this function rather than needing to own everything they use.
+    co_return co_await crasy::scoped([&](crasy::task_scope& scope) -> crasy::future<int> {
+        for (;;) {
+            remote_endpoint = crasy::endpoint(); // Reset remote endpoint
 
-        // Wait to receive data on the UDP socket
-        if (!check_result(co_await listen_socket.wait_read())) {
-            co_return 1;
-        }
+            // Wait to receive data on the UDP socket
+            if (!check_result(co_await listen_socket.wait_read())) {
+                co_return 1;
+            }
 
-        // Get the size of the received data and allocate enough space for it
-        auto size = check_result(listen_socket.available());
-        if (!size) {
-            co_return 1;
-        }
-        recv_buffer.resize(*size);
+            // Get the size of the received data and allocate enough space for it
+            auto size = check_result(listen_socket.available());
+            if (!size) {
+                co_return 1;
+            }
+            recv_buffer.resize(*size);
 
-        // Read the data from the UDP socket
-        if (!check_result(co_await listen_socket.recv_from(recv_buffer, remote_endpoint))) {
-            co_return 1;
-        }
+            // Read the data from the UDP socket
+            if (!check_result(co_await listen_socket.recv_from(recv_buffer, remote_endpoint))) {
+                co_return 1;
+            }
 
-        // Spawn a new async task to respond - While this task is working
-        // on sending the reponse, we can go back to listening for new
-        // packets.
-        crasy::spawn([=, &listen_socket] /* capture data by value! */ () mutable -> crasy::future<void> {
-            co_await echo(listen_socket, remote_endpoint, std::move(recv_buffer));
-        }).detach();
-    }
-    co_return 0;
+            // Spawn a new async task to respond - While this task is working
+            // on sending the reponse, we can go back to listening for new
+            // packets. The received data is handed over to the task rather
+            // than copied, and the socket is borrowed. The lambda is invoked
+            // right away, and the coroutine of echo is the task itself, so
+            // everything the task uses is passed to echo.
+            scope.spawn([&listen_socket, remote_endpoint, data = std::move(recv_buffer)]() mutable {
+                return echo(listen_socket, remote_endpoint, std::move(data));
+            });
+        }
+        co_return 0;
+    });
 }
 
 int main() {
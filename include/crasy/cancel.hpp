@@ -0,0 +1,59 @@
+#ifndef CRASY_CANCEL_HPP
+#define CRASY_CANCEL_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <coroutine>
+#include <stop_token>
+#include <utility>
+
+#include <crasy/future.hpp>
+
+namespace crasy {
+
+namespace detail {
+
+// Hands a future's coroutine its own cancel slot, without suspending it
+struct this_cancel_slot {
+    cancel_slot* slot{nullptr};
+
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> suspended) noexcept {
+        slot = &suspended.promise().cancellation();
+        return false;
+    }
+
+    cancel_slot& await_resume() const noexcept { return *slot; }
+};
+
+} // namespace detail
+
+/// @ingroup cancel_grp
+/// @brief Awaits `awaitable`, cancelling it once stop is requested on `stop`
+///
+/// The awaitable is cancelled as by @ref future::cancel: a pending I/O
+/// operation is aborted through asio, which frees its buffer and takes its
+/// socket out of the reactor right away, and fails with
+/// `asio::error::operation_aborted`, while a sleep ends early. Stop may be
+/// requested from any thread, before or while the awaitable is awaited.
+///
+/// ```cpp
+/// std::stop_source idle;
+/// auto res = co_await crasy::with_cancellation(sock.recv_from(buf, peer),
+///                                              idle.get_token());
+/// ```
+template <typename Awaitable>
+auto with_cancellation(Awaitable awaitable, std::stop_token stop)
+    -> future<decltype(std::declval<Awaitable&>().await_resume())> {
+    auto& slot = co_await detail::this_cancel_slot{};
+    std::stop_callback on_stop{std::move(stop), [&slot] { slot.cancel(); }};
+    co_return co_await std::move(awaitable);
+}
+
+} // namespace crasy
+
+#endif
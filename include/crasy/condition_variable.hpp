@@ -23,7 +23,7 @@ class CRASY_API condition_variable_wait_future_base {
     void notify();
 
     condition_variable* cv_;
-    std::coroutine_handle<> suspended_;
+    detail::waker suspended_;
     bool notified_{false};
 
     template <typename>
@@ -99,7 +99,7 @@ void condition_variable_wait_future<Lockable>::await_suspend(
     if (awaiter_.has_value()) {
         awaiter_->await_suspend(suspended);
     } else {
-        suspended_ = suspended;
+        suspended_ = detail::waker::current(suspended);
         cv_->waiters_.push(*this);
     }
 }
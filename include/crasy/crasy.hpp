@@ -5,22 +5,34 @@
 #include <crasy/config.hpp>
 // clang-format on
 
+#include <crasy/cancel.hpp>
 #include <crasy/condition_variable.hpp>
 #include <crasy/endpoint.hpp>
 #include <crasy/executor.hpp>
+#include <crasy/frame_pool.hpp>
 #include <crasy/future.hpp>
+#include <crasy/future_set.hpp>
+#include <crasy/interval.hpp>
 #include <crasy/ip_address.hpp>
+#include <crasy/join.hpp>
+#include <crasy/local_executor.hpp>
 #include <crasy/lock_guard.hpp>
 #include <crasy/mutex.hpp>
 #include <crasy/option.hpp>
+#include <crasy/priority.hpp>
 #include <crasy/result.hpp>
+#include <crasy/select.hpp>
+#include <crasy/shard.hpp>
 #include <crasy/shared_mutex.hpp>
 #include <crasy/sleep.hpp>
 #include <crasy/spawn.hpp>
 #include <crasy/spawn_blocking.hpp>
 #include <crasy/stream.hpp>
+#include <crasy/task_scope.hpp>
+#include <crasy/timeout.hpp>
 #include <crasy/udp.hpp>
 #include <crasy/unique_lock.hpp>
 #include <crasy/utils.hpp>
+#include <crasy/yield.hpp>
 
 #endif
@@ -14,14 +14,161 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <atomic>
 #include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+#include <crasy/priority.hpp>
 
 namespace crasy::detail {
 
+// Shard index meaning "whichever shard the executor sees fit"
+inline constexpr std::size_t NO_SHARD = ~std::size_t{0};
+
 CRASY_API bool in_executor_context();
+// Queues a task in the lane of the running task's priority
 CRASY_API void schedule_task(std::coroutine_handle<> handle);
+CRASY_API void schedule_task(std::coroutine_handle<> handle,
+                             std::size_t shard,
+                             priority prio);
+CRASY_API std::size_t current_shard();
+// Whether tasks spawned by the calling thread are only ever resumed on it
+CRASY_API bool tasks_stay_on_thread();
 CRASY_API asio::io_context& context();
+// Queues a task behind the others that are ready, rather than in front
+CRASY_API void yield_task(std::coroutine_handle<> handle);
+// Takes a unit from the running task's budget, returning false once the
+// budget is used up, at which point the caller should yield
+CRASY_API bool consume_budget();
+// Priority of the task running on the calling thread
+CRASY_API priority current_priority();
+// Called by the executors whenever they resume a task from their queues,
+// with the priority of the lane it was queued in. Resets the task's budget.
+CRASY_API void begin_task(priority prio);
+// Has the next future to start on the calling thread stay suspended at its
+// start, for take_deferred_start() to hand back, rather than run until it
+// first suspends
+CRASY_API void defer_next_start();
+// Whether a future starting now is to stay suspended at its start
+CRASY_API bool start_deferred();
+// Called by a future that stays suspended at its start
+CRASY_API void hold_start(std::coroutine_handle<> handle);
+// Ends the request of defer_next_start(), and returns the future that stayed
+// suspended at its start, if one did
+CRASY_API std::coroutine_handle<> take_deferred_start();
+// Queues blocking tasks on the executor's pool, or queues nothing if it
+// throws
 CRASY_API void run_blocking(void (*func)(void*), void* data);
+CRASY_API void run_blocking(void (*func)(void*),
+                            void* const* data,
+                            std::size_t count);
+
+class timer_wheel;
+struct timer_node;
+
+// Arms the timer on the timing wheel of the calling thread, to wake the
+// suspended task at its deadline. Returns false, without arming anything, if
+// the deadline has already passed.
+CRASY_API bool add_timer(timer_node& node, std::coroutine_handle<> suspended);
+// Arms a timer that calls its node's `fire` callback rather than waking a
+// task. Returns false, without arming anything, if the deadline has already
+// passed.
+CRASY_API bool add_timer(timer_node& node);
+
+// Something a suspended coroutine is waiting on that can be made to finish
+// early, such as an asio operation or a timer. `cancel` may be called from
+// any thread, and must not resume the coroutine on that thread.
+struct cancel_target {
+    void (*cancel)(void* data);
+    void* data;
+};
+
+// Links a coroutine to whatever it is suspended on, so that cancelling the
+// coroutine cancels that. Cancellation sticks: anything the coroutine waits
+// on later is cancelled as soon as it is attached.
+class cancel_slot {
+  public:
+    // Attaches what the coroutine is about to wait on, which must stay alive
+    // until it is detached. Fails if the coroutine has been cancelled, in
+    // which case the caller cancels the wait itself.
+    bool attach(cancel_target& target) {
+        auto state = empty;
+        return state_.compare_exchange_strong(
+            state, reinterpret_cast<std::uintptr_t>(&target),
+            std::memory_order_acq_rel);
+    }
+
+    // Detaches the target once the wait is over. A cancellation that has
+    // already picked up the target is waited for, since it may still be
+    // using it.
+    void detach(cancel_target& target) {
+        auto state = reinterpret_cast<std::uintptr_t>(&target);
+        if (!state_.compare_exchange_strong(state, empty,
+                                            std::memory_order_acq_rel) &&
+            state == busy) {
+            wait_for_cancel();
+        }
+    }
+
+    bool is_cancelled() const {
+        auto state = state_.load(std::memory_order_acquire);
+        return state == cancelled || state == busy;
+    }
+
+    CRASY_API void cancel();
+
+  private:
+    CRASY_API void wait_for_cancel() const;
+
+    static inline constexpr std::uintptr_t empty = 0;
+    static inline constexpr std::uintptr_t cancelled = 1;
+    // set while a cancellation runs the attached target's `cancel`
+    static inline constexpr std::uintptr_t busy = 2;
+    static_assert(alignof(cancel_target) > busy);
+
+    std::atomic<std::uintptr_t> state_{empty};
+};
+
+// A suspended task along with the shard it was suspended on, so that waking
+// it from another thread resumes it next to its sockets and timers, in the
+// lane of its priority
+struct waker {
+    std::coroutine_handle<> handle;
+    std::size_t shard{NO_SHARD};
+    priority prio{priority::normal};
+
+    static waker current(std::coroutine_handle<> suspended) {
+        return waker{suspended, current_shard(), current_priority()};
+    }
+
+    void wake() const { schedule_task(handle, shard, prio); }
+
+    explicit operator bool() const { return static_cast<bool>(handle); }
+};
+
+// Suspends the awaiting coroutine and queues it to be resumed by the executor,
+// on the given shard if one is specified, in the lane of the given priority
+struct schedule_awaiter {
+    std::size_t shard;
+    priority prio;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> suspended) const {
+        schedule_task(suspended, shard, prio);
+    }
+    void await_resume() const noexcept {}
+};
+
+// Suspends the awaiting coroutine and queues it behind the tasks that are
+// already ready to run
+struct yield_awaiter {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> suspended) const {
+        yield_task(suspended);
+    }
+    void await_resume() const noexcept {}
+};
 
 template <typename U>
 struct remove_rvalue_reference {
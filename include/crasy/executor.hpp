@@ -6,21 +6,108 @@
 // clang-format on
 
 #include <crasy/future.hpp>
-#include <crasy/lfqueue.hpp>
+#include <crasy/priority.hpp>
 
+#include <array>
+#include <asio/executor_work_guard.hpp>
 #include <asio/io_context.hpp>
-#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <latch>
+#include <memory>
 #include <mutex>
-#include <thread>
+#include <string>
 #include <vector>
 
 namespace crasy {
 
+class blocking_pool;
+class os_thread;
+
+/// @brief How an @ref executor distributes tasks and I/O over its core threads
+enum class executor_mode {
+    /// All core threads share one I/O context, and idle core threads steal
+    /// tasks from busy ones
+    work_stealing,
+    /// Each core thread is a shard that owns a private I/O context. Sockets
+    /// and timers stay on the shard that created them, and tasks stay on the
+    /// shard they were spawned on unless explicitly handed off with
+    /// @ref spawn_on or @ref move_to_shard.
+    sharded,
+};
+
+/// @brief How a core thread of an @ref executor waits for work once it has
+/// run out
+///
+/// An idle thread first spins for up to @ref spin, polling for tasks and
+/// I/O, then keeps polling for up to @ref yield while yielding the CPU to
+/// other threads in between, and only then parks in the OS until it is
+/// woken. Spinning trades CPU time for latency: work that arrives while a
+/// thread spins starts within a microsecond or so, without the system calls
+/// and scheduler delay of waking a parked thread. Spinning only pays off
+/// when every core thread, and the thread in @ref executor::block_on, has a
+/// CPU to itself; otherwise the spinning threads hold up the very threads
+/// that would give them work.
+struct park_policy {
+    /// Time spent busy-polling before yielding
+    std::chrono::microseconds spin{0};
+    /// Time spent polling and yielding before parking
+    std::chrono::microseconds yield{0};
+
+    /// Parks as soon as there is no work, which is the default
+    static constexpr park_policy park_immediately() { return {}; }
+
+    /// Never parks, keeping each core thread busy-polling, for deployments
+    /// that dedicate their cores to the lowest possible latency
+    static constexpr park_policy busy_poll() {
+        return {std::chrono::microseconds::max(), {}};
+    }
+
+    /// Whether threads ever park under this policy
+    constexpr bool parks() const {
+        return spin != std::chrono::microseconds::max() &&
+               yield != std::chrono::microseconds::max();
+    }
+};
+
+/// @brief Counts of how the threads of an @ref executor went idle and woke
+/// up again, as returned by @ref executor::parking_stats
+struct park_stats {
+    /// Times a thread ran out of work
+    std::uint64_t idle{0};
+    /// Times work turned up while a thread was spinning or yielding, so that
+    /// it did not have to park
+    std::uint64_t spin_hits{0};
+    /// Times a thread parked in the OS
+    std::uint64_t parks{0};
+    /// Wake-ups sent to parked threads
+    std::uint64_t unparks{0};
+};
+
 class CRASY_API executor {
   public:
+    class builder;
+
+    /// Default cap on the number of blocking threads
+    static inline constexpr std::size_t DEFAULT_MAX_BLOCKING_THREADS = 512;
+
+    /// Default time an idle blocking thread waits for work before exiting
+    static inline constexpr std::chrono::seconds DEFAULT_BLOCKING_KEEP_ALIVE{
+        10};
+
     executor();
     explicit executor(std::size_t core_threads);
-    executor(std::size_t core_threads, std::size_t max_threads);
+    /// Blocking threads are started on demand, up to `max_blocking_threads`,
+    /// and exit after being idle for @ref DEFAULT_BLOCKING_KEEP_ALIVE
+    executor(std::size_t core_threads, std::size_t max_blocking_threads);
+    executor(std::size_t core_threads, std::size_t max_blocking_threads,
+             executor_mode mode);
+    /// Idle core threads, and the thread in @ref block_on, wait for work as
+    /// set out by `parking`
+    executor(std::size_t core_threads, std::size_t max_blocking_threads,
+             executor_mode mode, park_policy parking);
 
     executor(const executor&) = delete;
     executor(executor&&) = delete;
@@ -30,6 +117,15 @@ class CRASY_API executor {
     executor& operator=(const executor&) = delete;
     executor& operator=(executor&&) = delete;
 
+    /// Runs the future returned by `func` until it completes, and returns its
+    /// result, or rethrows the exception escaping it.
+    ///
+    /// In @ref executor_mode::work_stealing mode, the calling thread works
+    /// alongside the core threads in the meantime: the future starts running
+    /// right away on the calling thread, which also runs other tasks and
+    /// polls for I/O. Only one thread at a time gets to do so. In
+    /// @ref executor_mode::sharded mode, or when the slot is taken, the
+    /// future runs on the core threads while the calling thread waits.
     template <typename F>
     decltype(auto) block_on(F&& func) {
         using fut_t = decltype(func());
@@ -51,17 +147,66 @@ class CRASY_API executor {
             block_on([f = std::forward<F>(func), &ret]() -> future<void> {
                 ret.emplace(co_await f());
             });
-            return *std::move(ret);
+            // returned by value, since the option is about to go away
+            typename fut_t::return_type value = *std::move(ret);
+            return value;
         }
     }
 
+    executor_mode mode() const { return mode_; }
+
+    /// How idle threads wait for work
+    park_policy parking() const { return parking_; }
+
+    /// Counts of how the threads have gone idle and been woken so far. The
+    /// counts are gathered without synchronization, so they are only
+    /// approximate while the executor is busy.
+    park_stats parking_stats() const;
+
+    /// Number of shards, which is the number of core threads in
+    /// @ref executor_mode::sharded mode, and one otherwise
+    std::size_t shard_count() const;
+
+    /// Slack of the timers armed without one of their own; see
+    /// @ref builder::timer_slack
+    std::chrono::microseconds timer_slack() const;
+
+    /// Changes the default timer slack, for timers armed from now on
+    void set_timer_slack(std::chrono::microseconds slack);
+
   private:
-    void schedule_task(std::coroutine_handle<> task);
-    void run_blocking(void (*func)(void*), void* data);
-    void core_work();
-    void blocking_work();
+    struct worker;
+
+    explicit executor(const builder& config);
+
+    static worker*& current_worker();
+    worker* local_worker() const;
+    void schedule_task(std::coroutine_handle<> task, std::size_t shard,
+                       priority prio);
+    void yield_task(std::coroutine_handle<> task, priority prio);
+    std::size_t current_shard() const;
+    asio::io_context& current_context();
+    detail::timer_wheel& current_timers();
+    void run_blocking(void (*func)(void*), void* const* data,
+                      std::size_t count);
+    void core_work(worker& self);
+
+    std::coroutine_handle<> next_task(worker& self);
+    std::coroutine_handle<> take_task(worker& self, std::size_t lane);
+    std::coroutine_handle<> steal_task(worker& self, std::size_t lane);
+    bool has_pending_tasks(const worker& self) const;
+    bool lane_has_tasks(const worker& self, std::size_t lane) const;
+    std::coroutine_handle<> take_injected(worker& self, std::size_t lane);
+    void park(worker& self);
+    bool spin(worker& self);
+    void notify_idle();
+    void wake_caller();
+    void signal_caller();
+    void notify_shard(worker& target);
+    std::size_t pick_shard();
 
     void block_on_impl(future<void> (*func)(void*), void* data);
+    void hand_off(future<void> (*func)(void*), void* data);
 
     template <typename F>
     static future<void> async_call(void* func) {
@@ -72,28 +217,153 @@ class CRASY_API executor {
         }
     }
 
-    struct blocking_task {
-        void (*func)(void*);
-        void* data;
+    // tasks woken from threads that cannot push to a core's own queue, with
+    // a queue for each priority lane
+    struct task_inbox {
+        void push(std::coroutine_handle<> task, std::size_t lane);
+        std::coroutine_handle<> take(std::size_t lane);
+        bool empty() const;
+        bool empty(std::size_t lane) const;
+
+        std::mutex mut;
+        std::array<std::deque<std::coroutine_handle<>>, detail::PRIORITY_LANES>
+            tasks;
+        std::array<std::atomic<std::size_t>, detail::PRIORITY_LANES> len{};
     };
 
+    executor_mode mode_;
+    park_policy parking_;
+    std::atomic<std::chrono::microseconds> timer_slack_;
+    bool precise_timer_slack_;
     asio::io_context context_;
-    std::vector<std::thread> core_workers_;
-    std::vector<std::thread> blocking_workers_;
-    std::size_t max_blocking_workers_{0};
-    lfqueue<blocking_task> blocking_tasks_;
-    std::mutex core_mut_;
-    std::condition_variable core_cv_;
-    std::mutex blocking_mut_;
-    std::condition_variable blocking_cv_;
-    std::atomic<size_t> blocking_waiting_{0};
-    bool core_work_pending_{false};
-    bool core_done_{false};
-    bool blocking_done_{false};
+    asio::executor_work_guard<asio::io_context::executor_type> core_guard_;
+    std::vector<std::unique_ptr<worker>> workers_;
+    // work-stealing mode only: the worker slot of the thread in block_on
+    worker* caller_{nullptr};
+    std::atomic<bool> caller_busy_{false};
+    std::atomic<std::size_t> next_shard_{0};
+    task_inbox inject_;
+    std::atomic<std::size_t> idle_workers_{0};
+    std::atomic<bool> wake_pending_{false};
+    std::atomic<std::uint64_t> unparks_{0};
+    std::atomic<bool> core_done_{false};
+    // the core threads and the constructor meet here once every core
+    // thread has built its worker
+    std::latch workers_built_;
+    std::vector<os_thread> core_workers_;
+    std::unique_ptr<blocking_pool> blocking_;
 
     friend void detail::schedule_task(std::coroutine_handle<>);
+    friend void detail::schedule_task(std::coroutine_handle<>, std::size_t,
+                                      priority);
+    friend std::size_t detail::current_shard();
+    friend bool detail::tasks_stay_on_thread();
     friend void detail::run_blocking(void (*func)(void*), void* data);
+    friend void detail::run_blocking(void (*func)(void*), void* const* data,
+                                     std::size_t count);
+    friend void detail::yield_task(std::coroutine_handle<>);
     friend asio::io_context& detail::context();
+    friend bool detail::add_timer(detail::timer_node&);
+};
+
+/// @brief Sets up an @ref executor in more detail than its constructors allow
+///
+/// Besides the options taken by the constructors, the builder can pin the
+/// core threads and blocking threads to sets of CPUs, name them, and set
+/// their stack sizes. Each core thread builds its own run queues and I/O
+/// context, and later its task frame pool, only once it runs on its CPU, so
+/// under the usual first-touch policy that memory lands on the NUMA node of
+/// that CPU.
+///
+/// ```cpp
+/// auto exec = crasy::executor::builder()
+///                 .core_cpus({0, 1, 2, 3})
+///                 .blocking_cpus({4, 5})
+///                 .core_thread_name("io")
+///                 .build();
+/// exec.block_on(crasy_main);
+/// ```
+///
+/// CPU affinity is supported on Linux and Windows, and stack sizes on POSIX
+/// systems; elsewhere those options are ignored.
+class CRASY_API executor::builder {
+  public:
+    /// Number of core threads, which defaults to one for each CPU given to
+    /// @ref core_cpus, or else to @ref available_cpu_cores
+    builder& core_threads(std::size_t count);
+
+    /// Cap on the number of blocking threads, which defaults to
+    /// @ref executor::DEFAULT_MAX_BLOCKING_THREADS
+    builder& max_blocking_threads(std::size_t count);
+
+    /// Time an idle blocking thread waits for work before exiting, which
+    /// defaults to @ref executor::DEFAULT_BLOCKING_KEEP_ALIVE
+    builder& blocking_keep_alive(std::chrono::nanoseconds keep_alive);
+
+    builder& mode(executor_mode mode);
+
+    builder& parking(park_policy parking);
+
+    /// How much later than its deadline a timer may fire, unless it is
+    /// given a slack of its own, as with @ref sleep_for. Each thread fires
+    /// the timers that fall due within the same window from a single
+    /// wake-up, so a few milliseconds of slack cut down on the wake-ups of
+    /// many periodic tasks. The default is zero.
+    builder& timer_slack(std::chrono::microseconds slack);
+
+    /// Cuts the kernel's own timer slack, which is 50 us by default on
+    /// Linux, to the least it allows on the threads that run the executor's
+    /// timers, for the sake of @ref precise_sleep_for. The core threads keep
+    /// it for their lifetime, and a thread in @ref executor::block_on until
+    /// it returns, when its slack is restored. Off by default, since it costs
+    /// more wake-ups; ignored outside Linux.
+    builder& precise_timer_slack(bool enable);
+
+    /// Pins each core thread to a single CPU, the `i`th thread to
+    /// `cpus[i % cpus.size()]`. CPUs are numbered from zero, as by the OS.
+    builder& core_cpus(std::vector<std::size_t> cpus);
+
+    /// Lets the blocking threads run on any of the given CPUs, but no others
+    builder& blocking_cpus(std::vector<std::size_t> cpus);
+
+    /// Names the core threads `name-0`, `name-1`, and so on. Names are cut
+    /// short to what the OS allows, which is 15 characters on Linux. The
+    /// default is `crasy-core`.
+    builder& core_thread_name(std::string name);
+
+    /// Names the blocking threads, `crasy-blocking` by default
+    builder& blocking_thread_name(std::string name);
+
+    /// Stack size of the core threads in bytes. The default of zero leaves
+    /// it to the OS.
+    builder& core_stack_size(std::size_t bytes);
+
+    /// Stack size of the blocking threads in bytes. The default of zero
+    /// leaves it to the OS.
+    builder& blocking_stack_size(std::size_t bytes);
+
+    /// Starts the executor's core threads. Throws `std::invalid_argument` if
+    /// the options are inconsistent, such as a CPU that does not exist, and
+    /// `std::system_error` if a thread fails to start.
+    executor build() const;
+
+  private:
+    option<std::size_t> core_threads_;
+    std::size_t max_blocking_threads_{executor::DEFAULT_MAX_BLOCKING_THREADS};
+    std::chrono::nanoseconds blocking_keep_alive_{
+        executor::DEFAULT_BLOCKING_KEEP_ALIVE};
+    executor_mode mode_{executor_mode::work_stealing};
+    park_policy parking_{park_policy::park_immediately()};
+    std::chrono::microseconds timer_slack_{0};
+    bool precise_timer_slack_{false};
+    std::vector<std::size_t> core_cpus_;
+    std::vector<std::size_t> blocking_cpus_;
+    std::string core_thread_name_{"crasy-core"};
+    std::string blocking_thread_name_{"crasy-blocking"};
+    std::size_t core_stack_size_{0};
+    std::size_t blocking_stack_size_{0};
+
+    friend class executor;
 };
 
 } // namespace crasy
@@ -0,0 +1,66 @@
+#ifndef CRASY_FRAME_POOL_HPP
+#define CRASY_FRAME_POOL_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <array>
+#include <cstddef>
+
+namespace crasy {
+
+/// Granularity of the coroutine frame size classes, in bytes
+inline constexpr std::size_t FRAME_CLASS_SIZE = 64;
+
+/// Number of coroutine frame size classes. Larger frames bypass the pool.
+inline constexpr std::size_t FRAME_CLASS_COUNT = 32;
+
+/// @brief Counters of the coroutine frame pool, summed over all threads
+struct frame_pool_stats {
+    /// Number of frames allocated
+    std::size_t allocations{0};
+    /// Number of frames served from a free list rather than the heap
+    std::size_t pool_hits{0};
+    /// Number of frames too large for any size class
+    std::size_t oversized{0};
+    /// Number of frames freed by a thread other than the one that
+    /// allocated them
+    std::size_t remote_frees{0};
+    /// Number of frames allocated in each size class, where class `i` holds
+    /// frames of up to `(i + 1) * FRAME_CLASS_SIZE` bytes, including the
+    /// pool's own bookkeeping
+    std::array<std::size_t, FRAME_CLASS_COUNT> class_allocations{};
+
+    double hit_rate() const {
+        return allocations == 0 ? 0.0 :
+                                  static_cast<double>(pool_hits) /
+                                      static_cast<double>(allocations);
+    }
+};
+
+/// @brief Returns the counters of the coroutine frame pool
+CRASY_API frame_pool_stats frame_pool_statistics();
+
+namespace detail {
+
+CRASY_API void* allocate_frame(std::size_t size);
+CRASY_API void deallocate_frame(void* frame) noexcept;
+
+// Base of crasy's promise types, so that their coroutine frames come from
+// the frame pool
+struct pooled_promise {
+#ifdef CRASY_HAS_FRAME_POOL
+    static void* operator new(std::size_t size) { return allocate_frame(size); }
+
+    static void operator delete(void* frame) noexcept {
+        deallocate_frame(frame);
+    }
+#endif
+};
+
+} // namespace detail
+
+} // namespace crasy
+
+#endif
@@ -5,49 +5,497 @@
 #include <crasy/config.hpp>
 // clang-format on
 
+#include <atomic>
 #include <coroutine>
+#include <cstdint>
 #include <exception>
+#include <type_traits>
 
 #include <crasy/detail.hpp>
+#include <crasy/frame_pool.hpp>
 #include <crasy/option.hpp>
+#include <crasy/result.hpp>
 
 namespace crasy {
 
+template <typename T>
+class join_handle;
+
+namespace detail {
+
+template <typename Awaitable>
+class timeout_future;
+
+struct future_access;
+class future_state;
+
+// Counts down the futures that a task awaits all at once, and resumes the
+// task when the last of them finishes. A join that gives up on the first
+// failure has that failure cancel the other futures. A select takes the
+// others back out of the group as soon as the first future finishes, and
+// the task is resumed by whoever is the last to let go of the group.
+class join_group {
+  public:
+    // Starts a join of `count` futures for the suspended task. The join
+    // holds one more count until end(), so that futures finishing while the
+    // others are being added cannot resume the task early.
+    void begin(std::coroutine_handle<> awaiter, std::size_t count,
+               cancel_target* on_failure) {
+        awaiter_ = awaiter;
+        on_failure_ = on_failure;
+        pending_.store(count + 1, std::memory_order_relaxed);
+    }
+
+    // Starts a select among `count` futures for the suspended task. Either
+    // end() or the first future to finish, whichever comes second, has
+    // `take_losers` take the others back out of the group through remove().
+    // The group holds one more count until then, which is given up last.
+    void begin_select(std::coroutine_handle<> awaiter, std::size_t count,
+                      cancel_target* take_losers) {
+        begin(awaiter, count, nullptr);
+        select_ = true;
+        take_losers_ = take_losers;
+        arrivals_.store(2, std::memory_order_relaxed);
+    }
+
+    // Adds a future to the group, counting it right away if it has finished
+    void add(future_state& state);
+
+    // Ends the adding of futures. Returns true if the task can go on without
+    // suspending: every future has finished, or for a select, one has.
+    bool end() {
+        if (select_) {
+            return arrivals_.fetch_sub(1, std::memory_order_acq_rel) == 1 &&
+                   settle();
+        }
+        return pending_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    // Called as each future finishes, and returns the coroutine to resume
+    // next. The group is not touched once the count drops.
+    std::coroutine_handle<> finish(future_state& state, bool failed) noexcept {
+        if (select_) {
+            // the winner's own count keeps the task from resuming meanwhile
+            if (claim_first(state) &&
+                arrivals_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                static_cast<void>(settle());
+            }
+            if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                return awaiter_;
+            }
+            return std::noop_coroutine();
+        }
+        if (failed && on_failure_ != nullptr && claim_first(state)) {
+            on_failure_->cancel(on_failure_->data);
+        }
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            return awaiter_;
+        }
+        return std::noop_coroutine();
+    }
+
+    // Takes a future that lost a select back out of the group, unless it is
+    // finishing, in which case it counts itself down
+    void remove(future_state& state);
+
+    // The future that failed first, for a join that gives up on failure, or
+    // that finished first, for a select
+    const future_state* first() const {
+        return first_.load(std::memory_order_acquire);
+    }
+
+  private:
+    // Takes the losers of a select out of the group, and gives up the count
+    // held until then. Returns true if nothing else holds the group.
+    bool settle() {
+        take_losers_->cancel(take_losers_->data);
+        return pending_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    bool claim_first(future_state& state) {
+        future_state* none = nullptr;
+        return first_.compare_exchange_strong(none, &state,
+                                              std::memory_order_acq_rel);
+    }
+
+    std::atomic<std::size_t> pending_{0};
+    // for a select, counts down end() and the first future to finish
+    std::atomic<int> arrivals_{0};
+    bool select_{false};
+    std::coroutine_handle<> awaiter_;
+    cancel_target* on_failure_{nullptr};
+    cancel_target* take_losers_{nullptr};
+    std::atomic<future_state*> first_{nullptr};
+};
+
+class ready_queue;
+
+// A future's place in a future_set, which goes on the set's ready queue once
+// the future finishes
+struct ready_node {
+    ready_queue* queue{nullptr};
+    ready_node* next_ready{nullptr};
+};
+
+// The futures of a set that have finished and are yet to be taken. Any
+// thread pushes onto it, and the task owning the set takes everything at
+// once. While it is empty, it may hold the owning task instead, waiting for
+// the next push. A set dropped while some of its futures are finishing hands
+// the queue over to them instead, and the last of them frees it.
+class ready_queue {
+  public:
+    // Called as a future of the set finishes, and returns the coroutine to
+    // resume next: the owning task, if it was waiting. The queue is not
+    // touched once the node is in. On a queue that was handed over, the node
+    // is dropped instead, which frees the finishing future.
+    std::coroutine_handle<> push(ready_node& node) noexcept {
+        auto head = head_.load(std::memory_order_acquire);
+        for (;;) {
+            if ((head & abandoned_tag) != 0) {
+                // published along with the tag
+                auto drop = drop_;
+                if (head_.compare_exchange_weak(head, head - abandoned_unit,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire)) {
+                    if (head - abandoned_unit == abandoned_tag) { delete this; }
+                    drop(node);
+                    return std::noop_coroutine();
+                }
+            } else if ((head & waiting_tag) != 0) {
+                node.next_ready = nullptr;
+                if (head_.compare_exchange_weak(
+                        head, reinterpret_cast<std::uintptr_t>(&node),
+                        std::memory_order_acq_rel,
+                        std::memory_order_acquire)) {
+                    return std::coroutine_handle<>::from_address(
+                        reinterpret_cast<void*>(head & ~waiting_tag));
+                }
+            } else {
+                node.next_ready = reinterpret_cast<ready_node*>(head);
+                if (head_.compare_exchange_weak(
+                        head, reinterpret_cast<std::uintptr_t>(&node),
+                        std::memory_order_release,
+                        std::memory_order_acquire)) {
+                    return std::noop_coroutine();
+                }
+            }
+        }
+    }
+
+    // Takes every node pushed so far, the latest first. A waiting task is
+    // forgotten.
+    ready_node* take() {
+        auto head = head_.exchange(0, std::memory_order_acquire);
+        if ((head & waiting_tag) != 0) { return nullptr; }
+        return reinterpret_cast<ready_node*>(head);
+    }
+
+    // Registers the owning task, to be resumed by the next push. Fails if
+    // there is a node to take already.
+    bool wait(std::coroutine_handle<> suspended) {
+        std::uintptr_t empty = 0;
+        return head_.compare_exchange_strong(
+            empty,
+            reinterpret_cast<std::uintptr_t>(suspended.address()) |
+                waiting_tag,
+            std::memory_order_acq_rel);
+    }
+
+    // Hands the queue over to the `count` futures that have yet to push
+    // themselves onto it, each of which is then freed by `drop`. Fails if
+    // there are nodes to take first.
+    bool abandon(std::size_t count, void (*drop)(ready_node& node)) {
+        drop_ = drop;
+        std::uintptr_t empty = 0;
+        return head_.compare_exchange_strong(
+            empty, count * abandoned_unit | abandoned_tag,
+            std::memory_order_acq_rel);
+    }
+
+  private:
+    // set on the address of the waiting task's frame
+    static inline constexpr std::uintptr_t waiting_tag = 1;
+    // set on the count of pushes left once the queue is handed over
+    static inline constexpr std::uintptr_t abandoned_tag = 2;
+    static inline constexpr std::uintptr_t abandoned_unit = 4;
+    static_assert(alignof(ready_node) >= abandoned_unit);
+
+    std::atomic<std::uintptr_t> head_{0};
+    void (*drop_)(ready_node& node){nullptr};
+};
+
+// Cancellation of a coroutine that other coroutines await, shared by the
+// promise types of futures and streams
+class cancellable_promise : public pooled_promise {
+  public:
+    // Cancels what the coroutine is waiting on, and anything it waits on
+    // later. May be called from any thread.
+    void cancel() { cancel_.cancel(); }
+
+    // Where the awaitables the coroutine suspends on attach, so that they
+    // can be cancelled
+    cancel_slot& cancellation() { return cancel_; }
+
+    // Links this coroutine to the slot of the coroutine awaiting it, if it
+    // has one, so that cancelling that one cancels this one too
+    void attach_awaiter(cancel_slot* awaiter) {
+        if (awaiter == nullptr) { return; }
+        awaiter_ = awaiter;
+        if (!awaiter->attach(as_target_)) { cancel(); }
+    }
+
+    void detach_awaiter() {
+        if (awaiter_ != nullptr) {
+            awaiter_->detach(as_target_);
+            awaiter_ = nullptr;
+        }
+    }
+
+  private:
+    static void cancel_coroutine(void* slot) {
+        static_cast<cancel_slot*>(slot)->cancel();
+    }
+
+    cancel_slot cancel_;
+    cancel_target as_target_{&cancel_coroutine, &cancel_};
+    cancel_slot* awaiter_{nullptr};
+};
+
+// Completion state of a future's coroutine, shared by the promise types. It
+// holds nothing while the coroutine runs, then either the awaiting coroutine,
+// a waker for a joining task, a join group, a node of a future set, or a
+// marker for a detached task, and finally the `done` marker.
+class future_state : public cancellable_promise {
+  public:
+    bool is_done() const {
+        return state_.load(std::memory_order_acquire) == done;
+    }
+
+    // Registers the awaiting coroutine, which is resumed directly by the
+    // thread finishing this one. Fails if already finished, in which case
+    // the awaiter must not suspend.
+    bool set_continuation(std::coroutine_handle<> suspended) {
+        auto state = running;
+        return state_.compare_exchange_strong(
+            state, reinterpret_cast<std::uintptr_t>(suspended.address()),
+            std::memory_order_acq_rel);
+    }
+
+    // Registers a joining task, which is resumed on its own shard. The waker
+    // must stay alive until then. Fails if already finished.
+    bool set_waker(const waker& joiner) {
+        auto state = running;
+        return state_.compare_exchange_strong(
+            state, reinterpret_cast<std::uintptr_t>(&joiner) | waker_tag,
+            std::memory_order_acq_rel);
+    }
+
+    // Registers a join of several futures. The group must stay alive until
+    // this finishes. Fails if already finished.
+    bool set_group(join_group& group) {
+        auto state = running;
+        return state_.compare_exchange_strong(
+            state, reinterpret_cast<std::uintptr_t>(&group) | group_tag,
+            std::memory_order_acq_rel);
+    }
+
+    // Takes back the registration of a join group. Fails if the coroutine
+    // has finished.
+    bool clear_group(join_group& group) {
+        auto state = reinterpret_cast<std::uintptr_t>(&group) | group_tag;
+        return state_.compare_exchange_strong(state, running,
+                                              std::memory_order_acq_rel);
+    }
+
+    // Registers the node of a future set. The set's ready queue must stay
+    // alive until this finishes. Fails if already finished.
+    bool set_ready_node(ready_node& node) {
+        auto state = running;
+        return state_.compare_exchange_strong(
+            state, reinterpret_cast<std::uintptr_t>(&node) | node_tag,
+            std::memory_order_acq_rel);
+    }
+
+    // Takes back the registration of a future set's node. Fails if the
+    // coroutine has finished, in which case the node is pushed anyway.
+    bool clear_ready_node(ready_node& node) {
+        auto state = reinterpret_cast<std::uintptr_t>(&node) | node_tag;
+        return state_.compare_exchange_strong(state, running,
+                                              std::memory_order_acq_rel);
+    }
+
+    // Whether the coroutine threw, or returned an error result
+    bool failed() const { return failed_; }
+
+    // Takes back the waker of a joining task that gives up waiting. Fails if
+    // the coroutine has finished, in which case the joiner is woken anyway.
+    bool clear_waker(const waker& joiner) {
+        auto state = reinterpret_cast<std::uintptr_t>(&joiner) | waker_tag;
+        return state_.compare_exchange_strong(state, running,
+                                              std::memory_order_acq_rel);
+    }
+
+    // Marks the coroutine to destroy itself when it finishes. Returns false
+    // if it has already finished, in which case the caller destroys it.
+    bool detach() {
+        auto state = state_.load(std::memory_order_acquire);
+        while (state != done) {
+            if (state_.compare_exchange_weak(state, detached,
+                                             std::memory_order_acq_rel)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Lets go of the coroutine for good. One that is still running is
+    // cancelled, and destroys itself once it has unwound.
+    void release(std::coroutine_handle<> self) {
+        if (!is_done()) {
+            cancel();
+            if (detach()) { return; }
+        }
+        self.destroy();
+    }
+
+    // Called once the coroutine is suspended at its final suspend point, and
+    // returns the coroutine to resume next
+    std::coroutine_handle<> complete(std::coroutine_handle<> self) noexcept {
+        auto state = state_.exchange(done, std::memory_order_acq_rel);
+        if (state == running) { return std::noop_coroutine(); }
+        if (state == detached) {
+            self.destroy();
+            return std::noop_coroutine();
+        }
+        if ((state & tag_mask) == group_tag) {
+            auto& group = *reinterpret_cast<join_group*>(state & ~tag_mask);
+            return group.finish(*this, failed_);
+        }
+        if ((state & tag_mask) == node_tag) {
+            auto& node = *reinterpret_cast<ready_node*>(state & ~tag_mask);
+            return node.queue->push(node);
+        }
+        if ((state & tag_mask) == waker_tag) {
+            auto joiner = *reinterpret_cast<const waker*>(state & ~tag_mask);
+            // the joiner only takes over this thread if it would not jump
+            // ahead of, or fall behind, the tasks in the other lanes
+            if (joiner.shard == current_shard() &&
+                joiner.prio == current_priority()) {
+                return joiner.handle;
+            }
+            joiner.wake();
+            return std::noop_coroutine();
+        }
+        return std::coroutine_handle<>::from_address(
+            reinterpret_cast<void*>(state));
+    }
+
+  private:
+    static inline constexpr std::uintptr_t running = 0;
+    static inline constexpr std::uintptr_t done = 1;
+    static inline constexpr std::uintptr_t detached = 2;
+    // set on the address of a waker, join group or ready node, which are at
+    // least 8 byte aligned
+    static inline constexpr std::uintptr_t waker_tag = 4;
+    static inline constexpr std::uintptr_t group_tag = 5;
+    static inline constexpr std::uintptr_t node_tag = 6;
+    static inline constexpr std::uintptr_t tag_mask = 7;
+    static_assert(alignof(waker) > tag_mask);
+    static_assert(alignof(join_group) > tag_mask);
+    static_assert(alignof(ready_node) > tag_mask);
+
+    std::atomic<std::uintptr_t> state_{running};
+
+  protected:
+    // set by the promise types before the coroutine finishes
+    bool failed_{false};
+};
+
+inline void join_group::add(future_state& state) {
+    if (!state.set_group(*this)) {
+        static_cast<void>(finish(state, state.failed()));
+    }
+}
+
+inline void join_group::remove(future_state& state) {
+    if (state.clear_group(*this)) {
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+// Initial suspend point of a future's coroutine, which runs on unless the
+// caller asked with defer_next_start() to queue it itself
+struct start_awaiter {
+    bool await_ready() const noexcept { return !start_deferred(); }
+    void await_suspend(std::coroutine_handle<> self) const noexcept {
+        hold_start(self);
+    }
+    void await_resume() const noexcept {}
+};
+
+// Slot of the suspending coroutine, if it is a future's or a stream's, to
+// which cancellable awaitables attach
+template <typename Promise>
+cancel_slot* cancel_slot_of(std::coroutine_handle<Promise> suspended) {
+    if constexpr (std::is_base_of_v<cancellable_promise, Promise>) {
+        return &suspended.promise().cancellation();
+    } else {
+        return nullptr;
+    }
+}
+
+} // namespace detail
+
 template <typename T>
 class future {
   public:
     using return_type = T;
 
-    class promise_type {
+    class promise_type : public detail::future_state {
+      private:
+        // the awaiter may destroy this future as soon as it is woken, so it
+        // is only resumed once this coroutine is fully suspended, directly
+        // through symmetric transfer rather than via the executor
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<promise_type> handle) noexcept {
+                return handle.promise().complete(handle);
+            }
+
+            void await_resume() noexcept {}
+        };
+
       public:
         future get_return_object() {
             return future(
                 std::coroutine_handle<promise_type>::from_promise(*this));
         }
 
-        void unhandled_exception() { ex_ = std::current_exception(); }
+        void unhandled_exception() {
+            ex_ = std::current_exception();
+            failed_ = true;
+        }
+
+        detail::start_awaiter initial_suspend() { return {}; }
 
-        std::suspend_never initial_suspend() { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
 
-        std::suspend_always final_suspend() noexcept {
-            done_ = true;
-            if (suspended_) {
-                auto suspended = suspended_;
-                suspended_ = std::coroutine_handle<>();
-                detail::schedule_task(suspended);
+        void return_value(T&& value) {
+            if constexpr (detail::is_result<std::remove_cvref_t<T>>) {
+                failed_ = value.is_err();
             }
-            return {};
+            value_.emplace(std::forward<T>(value));
         }
 
-        void return_value(T&& value) { value_.emplace(std::forward<T>(value)); }
-
       private:
         option<T> value_;
         std::exception_ptr ex_{nullptr};
-        std::coroutine_handle<> suspended_;
-        bool done_{false};
 
         friend class future;
+        template <typename>
+        friend class join_handle;
     };
 
     explicit future(std::coroutine_handle<promise_type> handle)
@@ -59,8 +507,10 @@ class future {
         other.handle_ = std::coroutine_handle<promise_type>();
     }
 
+    // A future dropped while it is still running is cancelled, and frees
+    // itself once it has unwound
     ~future() {
-        if (handle_) { handle_.destroy(); }
+        if (handle_) { handle_.promise().release(handle_); }
     }
 
     future& operator=(const future&) = delete;
@@ -72,14 +522,18 @@ class future {
         return *this;
     }
 
-    bool await_ready() const { return handle_.promise().done_; }
+    bool await_ready() const { return handle_.promise().is_done(); }
 
-    void await_suspend(std::coroutine_handle<> suspended) const {
-        handle_.promise().suspended_ = suspended;
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> suspended) const {
+        auto& promise = handle_.promise();
+        promise.attach_awaiter(detail::cancel_slot_of(suspended));
+        return promise.set_continuation(suspended);
     }
 
     T await_resume() const {
         auto& promise = handle_.promise();
+        promise.detach_awaiter();
         if (promise.ex_ != nullptr) {
             auto ex = promise.ex_;
             promise.ex_ = nullptr;
@@ -88,6 +542,17 @@ class future {
         return *std::move(promise.value_);
     }
 
+    /// @brief Requests that the future finish early
+    ///
+    /// The I/O operation or sleep that the future's coroutine is waiting on,
+    /// or the future it is awaiting, is cancelled, as is anything it waits
+    /// on from then on. Cancelled I/O operations fail with
+    /// `asio::error::operation_aborted`, and cancelled sleeps end early.
+    /// Waits on a @ref join_handle or on a synchronization primitive are
+    /// not cancelled. This may be called from any thread, and does not wait
+    /// for the future to finish.
+    void cancel() const { handle_.promise().cancel(); }
+
     std::coroutine_handle<promise_type> into_handle() && {
         auto handle = handle_;
         handle_ = std::coroutine_handle<promise_type>();
@@ -96,40 +561,54 @@ class future {
 
   private:
     std::coroutine_handle<promise_type> handle_;
+
+    friend struct detail::future_access;
 };
 
 template <>
 class future<void> {
   public:
-    class promise_type {
+    using return_type = void;
+
+    class promise_type : public detail::future_state {
+      private:
+        // the awaiter may destroy this future as soon as it is woken, so it
+        // is only resumed once this coroutine is fully suspended, directly
+        // through symmetric transfer rather than via the executor
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<promise_type> handle) noexcept {
+                return handle.promise().complete(handle);
+            }
+
+            void await_resume() noexcept {}
+        };
+
       public:
         future get_return_object() {
             return future(
                 std::coroutine_handle<promise_type>::from_promise(*this));
         }
 
-        void unhandled_exception() { ex_ = std::current_exception(); }
+        void unhandled_exception() {
+            ex_ = std::current_exception();
+            failed_ = true;
+        }
 
-        std::suspend_never initial_suspend() { return {}; }
+        detail::start_awaiter initial_suspend() { return {}; }
 
-        std::suspend_always final_suspend() noexcept {
-            done_ = true;
-            if (suspended_) {
-                auto suspended = suspended_;
-                suspended_ = std::coroutine_handle<>();
-                detail::schedule_task(suspended);
-            }
-            return {};
-        }
+        final_awaiter final_suspend() noexcept { return {}; }
 
         void return_void() {}
 
       private:
         std::exception_ptr ex_{nullptr};
-        std::coroutine_handle<> suspended_;
-        bool done_{false};
 
         friend class future;
+        template <typename>
+        friend class join_handle;
     };
 
     explicit future(std::coroutine_handle<promise_type> handle)
@@ -141,8 +620,10 @@ class future<void> {
         other.handle_ = std::coroutine_handle<promise_type>();
     }
 
+    // A future dropped while it is still running is cancelled, and frees
+    // itself once it has unwound
     ~future() {
-        if (handle_) { handle_.destroy(); }
+        if (handle_) { handle_.promise().release(handle_); }
     }
 
     future& operator=(const future&) = delete;
@@ -154,14 +635,18 @@ class future<void> {
         return *this;
     }
 
-    bool await_ready() const { return handle_.promise().done_; }
+    bool await_ready() const { return handle_.promise().is_done(); }
 
-    void await_suspend(std::coroutine_handle<> suspended) const {
-        handle_.promise().suspended_ = suspended;
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> suspended) const {
+        auto& promise = handle_.promise();
+        promise.attach_awaiter(detail::cancel_slot_of(suspended));
+        return promise.set_continuation(suspended);
     }
 
     void await_resume() const {
         auto& promise = handle_.promise();
+        promise.detach_awaiter();
         if (promise.ex_ != nullptr) {
             auto ex = promise.ex_;
             promise.ex_ = nullptr;
@@ -169,6 +654,17 @@ class future<void> {
         }
     }
 
+    /// @brief Requests that the future finish early
+    ///
+    /// The I/O operation or sleep that the future's coroutine is waiting on,
+    /// or the future it is awaiting, is cancelled, as is anything it waits
+    /// on from then on. Cancelled I/O operations fail with
+    /// `asio::error::operation_aborted`, and cancelled sleeps end early.
+    /// Waits on a @ref join_handle or on a synchronization primitive are
+    /// not cancelled. This may be called from any thread, and does not wait
+    /// for the future to finish.
+    void cancel() const { handle_.promise().cancel(); }
+
     std::coroutine_handle<promise_type> into_handle() && {
         auto handle = handle_;
         handle_ = std::coroutine_handle<promise_type>();
@@ -177,6 +673,8 @@ class future<void> {
 
   private:
     std::coroutine_handle<promise_type> handle_;
+
+    friend struct detail::future_access;
 };
 
 } // namespace crasy
@@ -0,0 +1,319 @@
+#ifndef CRASY_FUTURE_SET_HPP
+#define CRASY_FUTURE_SET_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include <crasy/detail.hpp>
+#include <crasy/future.hpp>
+#include <crasy/join.hpp>
+#include <crasy/option.hpp>
+#include <crasy/stream.hpp>
+
+namespace crasy {
+
+/// @ingroup combine_grp
+/// @brief A set of futures whose results are taken in the order the futures
+/// finish
+///
+/// Futures are pushed onto the set at any time, and @ref next awaits
+/// whichever finishes next. As with @ref join, the futures run within the
+/// task that owns the set, and no task is spawned for them. Each future that
+/// finishes puts itself on a queue of the set, which resumes the owning task
+/// if it is waiting, so that taking the next result costs the same however
+/// many futures are still running.
+///
+/// Cancelling the task while it awaits @ref next cancels every future in the
+/// set. Dropping the set cancels and lets go of the futures still running,
+/// each freeing itself once it has unwound. A set must only be used from the
+/// task that owns it.
+///
+/// ```cpp
+/// crasy::future_set<reply> pending;
+/// for (auto& req : batch) { pending.push(forward(req)); }
+/// while (auto rep = co_await pending.next()) {
+///     co_await respond(*rep);
+/// }
+/// ```
+template <typename T>
+class future_set {
+  private:
+    struct entry : detail::ready_node {
+        option<future<T>> fut;
+        // links of the entries in the set, or of the entries free for reuse
+        entry* prev{nullptr};
+        entry* next{nullptr};
+    };
+
+  public:
+    /// @brief What @ref next yields: the result of a future, or nothing once
+    /// the set is empty, which for futures of `void` is a `bool`
+    using next_type = std::conditional_t<std::is_void_v<T>, bool, option<T>>;
+
+    class next_future {
+      public:
+        explicit next_future(future_set& set) : set_(set) {}
+
+        next_future(const next_future&) = delete;
+        next_future& operator=(const next_future&) = delete;
+
+        bool await_ready() {
+            return set_.size_ == 0 ||
+                   (set_.has_ready() && detail::consume_budget());
+        }
+
+        template <typename Promise>
+        bool await_suspend(std::coroutine_handle<Promise> suspended) {
+            if (set_.has_ready()) {
+                // a future has finished, but the task is out of budget
+                detail::yield_task(suspended);
+                return true;
+            }
+            slot_ = detail::cancel_slot_of(suspended);
+            if (slot_ != nullptr && !slot_->attach(target_)) {
+                target_.cancel(target_.data);
+            }
+            if (set_.queue_->wait(suspended)) { return true; }
+            detach();
+            return false;
+        }
+
+        next_type await_resume() {
+            detach();
+            if (set_.size_ == 0) { return next_type{}; }
+            set_.has_ready();
+            return set_.take_next();
+        }
+
+      private:
+        static void cancel_all(void* set) {
+            static_cast<future_set*>(set)->cancel();
+        }
+
+        void detach() {
+            if (slot_ != nullptr) {
+                slot_->detach(target_);
+                slot_ = nullptr;
+            }
+        }
+
+        future_set& set_;
+        detail::cancel_slot* slot_{nullptr};
+        detail::cancel_target target_{&cancel_all, &set_};
+    };
+
+    future_set() : queue_(std::make_unique<detail::ready_queue>()) {}
+
+    future_set(const future_set&) = delete;
+
+    future_set(future_set&& other) noexcept { swap(other); }
+
+    ~future_set() {
+        if (!queue_) { return; }
+        // forgets the task waiting on the queue, which is only there if its
+        // frame is being destroyed
+        collect();
+        for (auto* e = live_; e != nullptr;) {
+            auto* next = e->next;
+            if (detail::future_access::state(*e->fut).clear_ready_node(*e)) {
+                --in_flight_;
+                unlink(*e);
+                delete e;
+            }
+            e = next;
+        }
+        // the futures that are finishing meanwhile are left to push
+        // themselves onto the queue, and free their own entries
+        free_ready();
+        while (in_flight_ != 0 && !queue_->abandon(in_flight_, &drop)) {
+            collect();
+            free_ready();
+        }
+        if (in_flight_ != 0) { static_cast<void>(queue_.release()); }
+        free_entries(free_);
+    }
+
+    future_set& operator=(const future_set&) = delete;
+
+    future_set& operator=(future_set&& rhs) noexcept {
+        swap(rhs);
+        return *this;
+    }
+
+    /// @brief Adds a future to the set
+    void push(future<T> fut) {
+        auto* e = free_;
+        if (e != nullptr) {
+            free_ = e->next;
+        } else {
+            e = new entry;
+            e->queue = queue_.get();
+        }
+        e->fut.emplace(std::move(fut));
+        e->prev = nullptr;
+        e->next = live_;
+        if (live_ != nullptr) { live_->prev = e; }
+        live_ = e;
+        ++size_;
+        if (detail::future_access::state(*e->fut).set_ready_node(*e)) {
+            ++in_flight_;
+        } else {
+            append_ready(*e);
+        }
+    }
+
+    /// @brief Awaits the next future of the set to finish, and takes it out
+    /// of the set
+    ///
+    /// Yields the future's result, or rethrows its exception, in the order
+    /// the futures finish. Yields nothing right away if the set is empty.
+    next_future next() { return next_future{*this}; }
+
+    /// @brief Takes the result of a future of the set that has finished, if
+    /// there is one, without waiting
+    next_type try_next() {
+        if (!has_ready()) { return next_type{}; }
+        return take_next();
+    }
+
+    /// @brief Cancels every future in the set, as by @ref future::cancel
+    void cancel() {
+        for (auto* e = live_; e != nullptr; e = e->next) { e->fut->cancel(); }
+    }
+
+    /// @brief Number of futures whose results are yet to be taken
+    std::size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    /// @brief Turns the set into a stream of the results, in the order the
+    /// futures finish, which ends once the set is empty
+    stream<T> into_stream() &&
+        requires(!std::is_void_v<T>)
+    {
+        return drain(std::move(*this));
+    }
+
+  private:
+    static stream<T> drain(future_set set) {
+        while (auto value = co_await set.next()) {
+            co_yield *std::move(value);
+        }
+    }
+
+    static void free_entries(entry* e) {
+        while (e != nullptr) { delete std::exchange(e, e->next); }
+    }
+
+    static void drop(detail::ready_node& node) {
+        delete static_cast<entry*>(&node);
+    }
+
+    void unlink(entry& e) {
+        if (e.prev != nullptr) {
+            e.prev->next = e.next;
+        } else {
+            live_ = e.next;
+        }
+        if (e.next != nullptr) { e.next->prev = e.prev; }
+    }
+
+    // Frees the entries that have finished, whose results are dropped
+    void free_ready() {
+        while (ready_head_ != nullptr) {
+            auto& e = static_cast<entry&>(*ready_head_);
+            ready_head_ = e.next_ready;
+            unlink(e);
+            delete &e;
+        }
+        ready_tail_ = nullptr;
+    }
+
+    void swap(future_set& other) noexcept {
+        std::swap(queue_, other.queue_);
+        std::swap(live_, other.live_);
+        std::swap(free_, other.free_);
+        std::swap(ready_head_, other.ready_head_);
+        std::swap(ready_tail_, other.ready_tail_);
+        std::swap(size_, other.size_);
+        std::swap(in_flight_, other.in_flight_);
+    }
+
+    void append_ready(detail::ready_node& node) {
+        node.next_ready = nullptr;
+        if (ready_tail_ != nullptr) {
+            ready_tail_->next_ready = &node;
+        } else {
+            ready_head_ = &node;
+        }
+        ready_tail_ = &node;
+    }
+
+    // Moves what the queue holds to the end of the ready list
+    void collect() {
+        auto* node = queue_->take();
+        if (node == nullptr) { return; }
+        // the queue gives the latest first
+        auto* last = node;
+        detail::ready_node* batch = nullptr;
+        while (node != nullptr) {
+            auto* next = node->next_ready;
+            node->next_ready = batch;
+            batch = node;
+            node = next;
+            --in_flight_;
+        }
+        if (ready_tail_ != nullptr) {
+            ready_tail_->next_ready = batch;
+        } else {
+            ready_head_ = batch;
+        }
+        ready_tail_ = last;
+    }
+
+    bool has_ready() {
+        if (ready_head_ == nullptr) { collect(); }
+        return ready_head_ != nullptr;
+    }
+
+    next_type take_next() {
+        auto& e = static_cast<entry&>(*ready_head_);
+        ready_head_ = e.next_ready;
+        if (ready_head_ == nullptr) { ready_tail_ = nullptr; }
+        unlink(e);
+        auto fut = *std::move(e.fut);
+        e.fut.reset();
+        e.next = free_;
+        free_ = &e;
+        --size_;
+        if constexpr (std::is_void_v<T>) {
+            fut.await_resume();
+            return true;
+        } else {
+            return next_type{std::in_place, fut.await_resume()};
+        }
+    }
+
+    std::unique_ptr<detail::ready_queue> queue_;
+    // every entry whose result is yet to be taken
+    entry* live_{nullptr};
+    entry* free_{nullptr};
+    // the entries that have finished, in order, ahead of those on the queue
+    detail::ready_node* ready_head_{nullptr};
+    detail::ready_node* ready_tail_{nullptr};
+    std::size_t size_{0};
+    // entries that are to go through the queue, and have not been taken
+    // from it yet
+    std::size_t in_flight_{0};
+};
+
+} // namespace crasy
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef CRASY_INTERVAL_HPP
+#define CRASY_INTERVAL_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <crasy/sleep.hpp>
+#include <crasy/stream.hpp>
+
+#include <chrono>
+#include <cstdint>
+
+namespace crasy {
+
+/// @brief What an @ref interval does about ticks it has fallen behind on,
+/// because the consumer took longer than a period to come back for the next
+/// tick
+enum class missed_tick : std::uint8_t {
+    /// Yields the missed ticks right away, one after another, until it has
+    /// caught up, keeping the ticks on their original schedule
+    burst,
+    /// Starts a new schedule a period after the late tick was taken, so that
+    /// ticks are never less than a period apart
+    delay,
+    /// Drops the missed ticks, and carries on with the next tick of the
+    /// original schedule that is still to come
+    skip,
+};
+
+/// @ingroup sleep_grp
+/// @brief Yields the time of each tick of a periodic schedule, starting
+/// right away
+///
+/// Ticks are scheduled a whole number of periods after the start, rather
+/// than a period after the previous tick was taken, so the schedule does not
+/// drift however long the consumer takes with each tick. The stream reuses
+/// a single timer for all of its ticks, which fires with the executor's
+/// default slack; see @ref executor::builder::timer_slack. The yielded time
+/// is when the tick was due, which is at most when it was taken. Cancelling
+/// the task while it waits for a tick ends the stream.
+///
+/// ```cpp
+/// auto ticks = crasy::interval(1s);
+/// while (co_await ticks) {
+///     co_await flush_metrics();
+/// }
+/// ```
+///
+/// Throws `std::invalid_argument` if the period is not positive.
+CRASY_API stream<std::chrono::steady_clock::time_point> interval(
+    std::chrono::steady_clock::duration period,
+    missed_tick missed = missed_tick::burst);
+
+/// @ingroup sleep_grp
+/// @brief Like @ref interval, but with the first tick due at `start`
+CRASY_API stream<std::chrono::steady_clock::time_point> interval_at(
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::duration period,
+    missed_tick missed = missed_tick::burst);
+
+} // namespace crasy
+
+#endif
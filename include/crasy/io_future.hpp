@@ -5,21 +5,56 @@
 #include <crasy/config.hpp>
 // clang-format on
 
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+#endif
+#include <asio/cancellation_signal.hpp>
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
 #include <atomic>
 #include <coroutine>
 
+#include <crasy/detail.hpp>
+#include <crasy/future.hpp>
+#include <crasy/priority.hpp>
+
 namespace crasy::detail {
 
+// Awaitable for a single asio operation. The operation's completion handler
+// is bound to cancellation_slot(), so that cancelling the coroutine awaiting
+// it cancels the operation, which then completes with operation_aborted.
 class io_future {
   public:
     bool await_ready() const;
-    void await_suspend(std::coroutine_handle<> suspended);
+
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> suspended) {
+        suspend(suspended, cancel_slot_of(suspended));
+    }
 
   protected:
+    asio::cancellation_slot cancellation_slot() { return signal_.slot(); }
+
+    // For operations that are cancelled some other way than through their
+    // cancellation slot
+    void set_canceller(void (*cancel)(void*), void* data) {
+        target_ = cancel_target{cancel, data};
+    }
+
     void finish();
 
   private:
+    void suspend(std::coroutine_handle<> suspended, cancel_slot* slot);
+    static void emit(void* self);
+
     std::atomic<void*> suspended_;
+    priority priority_{priority::normal};
+    cancel_slot* slot_{nullptr};
+    cancel_target target_{&emit, this};
+    asio::cancellation_signal signal_;
 };
 
 } // namespace crasy::detail
@@ -0,0 +1,355 @@
+#ifndef CRASY_JOIN_HPP
+#define CRASY_JOIN_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <coroutine>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <crasy/detail.hpp>
+#include <crasy/future.hpp>
+#include <crasy/option.hpp>
+#include <crasy/result.hpp>
+
+namespace crasy {
+
+namespace detail {
+
+struct future_access {
+    template <typename T>
+    static future_state& state(future<T>& fut) {
+        return fut.handle_.promise();
+    }
+};
+
+// What a joined future of type T contributes to a tuple of results
+template <typename T>
+using join_value_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template <typename T>
+join_value_t<T> take_value(future<T>& fut) {
+    if constexpr (std::is_void_v<T>) {
+        fut.await_resume();
+        return {};
+    } else {
+        return fut.await_resume();
+    }
+}
+
+template <typename T, typename E>
+join_value_t<T> take_ok(result<T, E>&& res) {
+    if constexpr (std::is_void_v<T>) {
+        return {};
+    } else {
+        return std::move(res).ok();
+    }
+}
+
+enum class join_mode {
+    all,
+    // gives up on the first failure
+    all_or_failure,
+    // a select, which is done once the first future finishes
+    first,
+};
+
+// Awaits a set of futures at once from the awaiting task. The state of the
+// join lives in the awaitable, and so in the task's frame, and the future
+// whose turn it is resumes the task directly, as when awaited alone.
+// Cancelling the task cancels every future.
+class join_base {
+  public:
+    join_base(const join_base&) = delete;
+    join_base(join_base&&) = delete;
+    join_base& operator=(const join_base&) = delete;
+    join_base& operator=(join_base&&) = delete;
+
+  protected:
+    join_base(void (*cancel_all)(void*), void (*remove_all)(void*),
+              void* self)
+        : target_{cancel_all, self}, losers_{remove_all, self} {}
+
+    ~join_base() = default;
+
+    // Adds each future, through `for_each`, to a join for the suspended
+    // task. Returns false if the join is over already.
+    template <typename Promise, typename ForEach>
+    bool suspend(std::coroutine_handle<Promise> suspended, std::size_t count,
+                 join_mode mode, ForEach&& for_each) {
+        if (mode == join_mode::first) {
+            group_.begin_select(suspended, count, &losers_);
+        } else {
+            group_.begin(suspended, count,
+                         mode == join_mode::all_or_failure ? &target_
+                                                           : nullptr);
+        }
+        slot_ = cancel_slot_of(suspended);
+        if (slot_ != nullptr && !slot_->attach(target_)) {
+            target_.cancel(target_.data);
+        }
+        for_each([this](future_state& state) { group_.add(state); });
+        if (group_.end()) {
+            resume();
+            return false;
+        }
+        return true;
+    }
+
+    // Called before the futures are looked at in await_resume()
+    void resume() {
+        if (slot_ != nullptr) {
+            slot_->detach(target_);
+            slot_ = nullptr;
+        }
+    }
+
+    // Takes a future that lost a select back out of the join
+    void remove(future_state& state) { group_.remove(state); }
+
+    // The future that failed first, for a join that gives up on failure, or
+    // that finished first, for a select
+    const future_state* first() const { return group_.first(); }
+
+  private:
+    join_group group_;
+    cancel_slot* slot_{nullptr};
+    cancel_target target_;
+    // takes the losers of a select out of the join
+    cancel_target losers_;
+};
+
+template <join_mode Mode, typename... Ts>
+class join_future : public join_base {
+  public:
+    explicit join_future(future<Ts>&&... futures)
+        : join_base(&cancel_all, &remove_all, this),
+          futures_(std::move(futures)...) {}
+
+    bool await_ready() const {
+        return std::apply(
+            [](const auto&... futs) { return (futs.await_ready() && ...); },
+            futures_);
+    }
+
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> suspended) {
+        return suspend(suspended, sizeof...(Ts), Mode, [this](auto add) {
+            std::apply(
+                [&](auto&... futs) {
+                    (add(future_access::state(futs)), ...);
+                },
+                futures_);
+        });
+    }
+
+    auto await_resume() {
+        resume();
+        return std::apply(
+            [](auto&... futs) {
+                return std::tuple<join_value_t<Ts>...>{take_value(futs)...};
+            },
+            futures_);
+    }
+
+  private:
+    static void cancel_all(void* self) {
+        std::apply([](auto&... futs) { (futs.cancel(), ...); },
+                   static_cast<join_future*>(self)->futures_);
+    }
+
+    static void remove_all(void* self) {
+        auto& join = *static_cast<join_future*>(self);
+        std::apply(
+            [&](auto&... futs) {
+                (join.remove(future_access::state(futs)), ...);
+            },
+            join.futures_);
+    }
+
+  protected:
+    std::tuple<future<Ts>...> futures_;
+};
+
+template <typename E, typename... Ts>
+class try_join_future
+    : public join_future<join_mode::all_or_failure, result<Ts, E>...> {
+  public:
+    using join_future<join_mode::all_or_failure,
+                      result<Ts, E>...>::join_future;
+
+    result<std::tuple<join_value_t<Ts>...>, E> await_resume() {
+        this->resume();
+        if (auto failure = this->first(); failure != nullptr) {
+            // the others were cancelled because of this one, so their errors
+            // say little
+            option<E> error;
+            std::apply(
+                [&](auto&... futs) {
+                    ((&future_access::state(futs) == failure
+                          ? static_cast<void>(
+                                error.emplace(futs.await_resume().err()))
+                          : static_cast<void>(0)),
+                     ...);
+                },
+                this->futures_);
+            return err(std::move(*error));
+        }
+        return std::apply(
+            [](auto&... futs) {
+                return ok(std::tuple<join_value_t<Ts>...>{
+                    take_ok(futs.await_resume())...});
+            },
+            this->futures_);
+    }
+};
+
+template <join_mode Mode, typename T>
+class join_all_future : public join_base {
+  public:
+    explicit join_all_future(std::vector<future<T>>&& futures)
+        : join_base(&cancel_all, nullptr, this), futures_(std::move(futures)) {}
+
+    bool await_ready() const {
+        for (const auto& fut : futures_) {
+            if (!fut.await_ready()) { return false; }
+        }
+        return true;
+    }
+
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> suspended) {
+        return suspend(suspended, futures_.size(), Mode, [this](auto add) {
+            for (auto& fut : futures_) { add(future_access::state(fut)); }
+        });
+    }
+
+    auto await_resume() {
+        resume();
+        if constexpr (std::is_void_v<T>) {
+            for (auto& fut : futures_) { fut.await_resume(); }
+        } else {
+            std::vector<T> values;
+            values.reserve(futures_.size());
+            for (auto& fut : futures_) { values.push_back(fut.await_resume()); }
+            return values;
+        }
+    }
+
+  private:
+    static void cancel_all(void* self) {
+        for (auto& fut : static_cast<join_all_future*>(self)->futures_) {
+            fut.cancel();
+        }
+    }
+
+  protected:
+    std::vector<future<T>> futures_;
+};
+
+template <typename T, typename E>
+class try_join_all_future
+    : public join_all_future<join_mode::all_or_failure, result<T, E>> {
+  public:
+    using join_all_future<join_mode::all_or_failure,
+                          result<T, E>>::join_all_future;
+
+    auto await_resume()
+        -> result<std::conditional_t<std::is_void_v<T>, void, std::vector<T>>,
+                  E> {
+        this->resume();
+        if (auto failure = this->first(); failure != nullptr) {
+            for (auto& fut : this->futures_) {
+                if (&future_access::state(fut) == failure) {
+                    return err(fut.await_resume().err());
+                }
+            }
+        }
+        if constexpr (std::is_void_v<T>) {
+            return ok();
+        } else {
+            std::vector<T> values;
+            values.reserve(this->futures_.size());
+            for (auto& fut : this->futures_) {
+                values.push_back(fut.await_resume().ok());
+            }
+            return ok(std::move(values));
+        }
+    }
+};
+
+} // namespace detail
+
+/// @ingroup combine_grp
+/// @brief Awaits several futures at once, for a tuple of their results
+///
+/// The futures run concurrently, as all futures do, but within the awaiting
+/// task rather than as tasks of their own: nothing is spawned or allocated,
+/// and the last future to finish resumes the task directly. A future of
+/// `void` yields `std::monostate`. If any future throws, the first in
+/// argument order to have thrown rethrows, once they have all finished.
+/// Cancelling the awaiting task cancels every future.
+///
+/// ```cpp
+/// auto [user, orders] = co_await crasy::join(fetch_user(id),
+///                                           fetch_orders(id));
+/// ```
+template <typename... Ts>
+detail::join_future<detail::join_mode::all, Ts...> join(
+    future<Ts>... futures) {
+    return detail::join_future<detail::join_mode::all, Ts...>{
+        std::move(futures)...};
+}
+
+/// @ingroup combine_grp
+/// @brief Awaits several futures of results at once, giving up on the first
+/// error
+///
+/// Like @ref join, but for futures that return a @ref result with the same
+/// error type. The first future to fail, by returning an error or throwing,
+/// cancels the others, and its error is returned once they have unwound.
+/// Otherwise, the tuple of the values is returned.
+template <typename E, typename... Ts>
+detail::try_join_future<E, Ts...> try_join(future<result<Ts, E>>... futures) {
+    return detail::try_join_future<E, Ts...>{std::move(futures)...};
+}
+
+/// @ingroup combine_grp
+/// @brief Awaits a vector of futures at once, for a vector of their results
+///
+/// Like @ref join, for a number of futures only known at run time. The only
+/// allocation is that of the returned vector, and none is made for futures
+/// of `void`, for which nothing is returned.
+///
+/// ```cpp
+/// std::vector<crasy::future<reply>> requests;
+/// for (auto& peer : peers) { requests.push_back(ask(peer)); }
+/// auto replies = co_await crasy::join_all(std::move(requests));
+/// ```
+template <typename T>
+detail::join_all_future<detail::join_mode::all, T> join_all(
+    std::vector<future<T>> futures) {
+    return detail::join_all_future<detail::join_mode::all, T>{
+        std::move(futures)};
+}
+
+/// @ingroup combine_grp
+/// @brief Awaits a vector of futures of results at once, giving up on the
+/// first error
+///
+/// Like @ref join_all, with errors handled as by @ref try_join
+template <typename T, typename E>
+detail::try_join_all_future<T, E> try_join_all(
+    std::vector<future<result<T, E>>> futures) {
+    return detail::try_join_all_future<T, E>{std::move(futures)};
+}
+
+} // namespace crasy
+
+#endif
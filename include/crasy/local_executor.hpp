@@ -0,0 +1,150 @@
+#ifndef CRASY_LOCAL_EXECUTOR_HPP
+#define CRASY_LOCAL_EXECUTOR_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <crasy/executor.hpp>
+#include <crasy/future.hpp>
+#include <crasy/priority.hpp>
+#include <crasy/shard.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <asio/io_context.hpp>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace crasy {
+
+/// @brief Executor that runs all tasks and I/O on the calling thread
+///
+/// `block_on` drives the tasks and the I/O reactor on the thread that calls
+/// it, without any core threads of its own. Tasks are queued in a plain
+/// deque, so scheduling takes no locks or atomics. Since a task never leaves
+/// this thread, it may hold state that is not thread-safe; see
+/// @ref spawn_local.
+///
+/// Blocking tasks still run on their own threads, started on demand as with
+/// @ref executor. Completions and wake-ups arriving from those threads are
+/// posted to the calling thread.
+///
+/// ```cpp
+/// crasy::local_executor().block_on(crasy_main);
+/// ```
+///
+/// A local executor must only be driven by one thread at a time, and cannot
+/// be nested with another executor on the same thread.
+class CRASY_API local_executor {
+  public:
+    local_executor();
+    /// Blocking threads are started on demand, up to `max_blocking_threads`
+    explicit local_executor(std::size_t max_blocking_threads);
+
+    local_executor(const local_executor&) = delete;
+    local_executor(local_executor&&) = delete;
+
+    ~local_executor();
+
+    local_executor& operator=(const local_executor&) = delete;
+    local_executor& operator=(local_executor&&) = delete;
+
+    /// Runs tasks on the calling thread until the future returned by `func`
+    /// completes, and returns its result. An exception escaping the future
+    /// is rethrown.
+    template <typename F>
+    decltype(auto) block_on(F&& func) {
+        using fut_t = decltype(func());
+        if constexpr (std::is_same_v<fut_t, future<void>>) {
+            if constexpr (std::is_pointer_v<std::remove_reference_t<F>>) {
+                block_on_impl(
+                    &local_executor::async_call<std::remove_reference_t<F>>,
+                    reinterpret_cast<void*>(func));
+            } else if constexpr (std::is_function_v<
+                                     std::remove_reference_t<F>>) {
+                block_on_impl(
+                    &local_executor::async_call<std::remove_reference_t<F>*>,
+                    reinterpret_cast<void*>(&func));
+            } else {
+                block_on_impl(
+                    &local_executor::async_call<std::remove_reference_t<F>>,
+                    &func);
+            }
+        } else {
+            option<typename fut_t::return_type> ret;
+            block_on([f = std::forward<F>(func), &ret]() -> future<void> {
+                ret.emplace(co_await f());
+            });
+            // returned by value, since the option is about to go away
+            typename fut_t::return_type value = *std::move(ret);
+            return value;
+        }
+    }
+
+    /// Slack of the timers armed without one of their own, which is zero
+    /// unless changed; see @ref executor::builder::timer_slack
+    std::chrono::microseconds timer_slack() const;
+
+    /// Changes the default timer slack, for timers armed from now on
+    void set_timer_slack(std::chrono::microseconds slack);
+
+  private:
+    static local_executor* current();
+    bool on_thread() const;
+    void schedule_task(std::coroutine_handle<> task, priority prio);
+    void yield_task(std::coroutine_handle<> task, priority prio);
+    std::coroutine_handle<> next_task();
+    std::coroutine_handle<> take_task(std::size_t lane);
+    bool lane_has_tasks(std::size_t lane) const;
+    void run_blocking(void (*func)(void*), void* const* data,
+                      std::size_t count);
+
+    void block_on_impl(future<void> (*func)(void*), void* data);
+
+    template <typename F>
+    static future<void> async_call(void* func) {
+        if constexpr (std::is_pointer_v<F>) {
+            return reinterpret_cast<F>(func)();
+        } else {
+            return (*reinterpret_cast<F*>(func))();
+        }
+    }
+
+    using lane_queues =
+        std::array<std::deque<std::coroutine_handle<>>, detail::PRIORITY_LANES>;
+
+    asio::io_context context_{1};
+    lane_queues ready_;
+    // tasks that yielded, run once the ready ones in their lane and pending
+    // I/O have had a turn
+    lane_queues yielded_;
+    // how many times in a row each lane was passed over while it had tasks
+    std::array<std::uint32_t, detail::PRIORITY_LANES> passed_{};
+    std::atomic<std::chrono::microseconds> timer_slack_{
+        std::chrono::microseconds{0}};
+    std::unique_ptr<detail::timer_wheel> timers_;
+    std::unique_ptr<blocking_pool> blocking_;
+
+    friend bool detail::in_executor_context();
+    friend void detail::schedule_task(std::coroutine_handle<>);
+    friend void detail::schedule_task(std::coroutine_handle<>, std::size_t,
+                                      priority);
+    friend std::size_t detail::current_shard();
+    friend bool detail::tasks_stay_on_thread();
+    friend void detail::run_blocking(void (*func)(void*), void* data);
+    friend void detail::run_blocking(void (*func)(void*), void* const* data,
+                                     std::size_t count);
+    friend void detail::yield_task(std::coroutine_handle<>);
+    friend asio::io_context& detail::context();
+    friend bool detail::add_timer(detail::timer_node&);
+    friend std::size_t shard_count();
+};
+
+} // namespace crasy
+
+#endif
@@ -6,9 +6,10 @@
 // clang-format on
 
 #include <atomic>
+#include <deque>
+#include <mutex>
 
 #include <crasy/future.hpp>
-#include <crasy/lfqueue.hpp>
 
 namespace crasy {
 
@@ -23,7 +24,25 @@ class CRASY_API mutex_lock_future {
   private:
     explicit mutex_lock_future(mutex& mtx);
 
+    // Like await_suspend(), but fails without waiting if abandon_wait() got
+    // there first
+    bool suspend_unless_abandoned(std::coroutine_handle<> suspended);
+
+    // Takes the suspended task out of the mutex's waiters, unless the lock
+    // has already been handed to it. A wait that has not started yet is
+    // blocked instead.
+    bool abandon_wait(std::coroutine_handle<> suspended);
+
     mutex* mtx_;
+    // the lock was free, but the task was out of budget
+    bool yield_{false};
+    // guarded by the mutex's `mut_`
+    bool started_{false};
+    bool abandoned_{false};
+
+    friend class mutex;
+    template <typename>
+    friend class detail::timeout_future;
 };
 
 /// @ingroup sync_grp
@@ -42,7 +61,10 @@ class CRASY_API mutex {
 
   private:
     std::atomic<bool> locked_{false};
-    lfqueue<std::coroutine_handle<>> suspended_;
+    // guards suspended_; unlock() hands the lock straight to the first
+    // waiter, so locked_ is only cleared while nobody is waiting
+    std::mutex mut_;
+    std::deque<detail::waker> suspended_;
 
     friend class mutex_lock_future;
 };
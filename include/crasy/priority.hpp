@@ -0,0 +1,53 @@
+#ifndef CRASY_PRIORITY_HPP
+#define CRASY_PRIORITY_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <cstddef>
+#include <cstdint>
+
+namespace crasy {
+
+/// @brief Scheduling class of a task
+/// @ingroup spawn_grp
+///
+/// The executors keep a separate run queue, or lane, for each class, and
+/// always take the next task from the most urgent lane that has one ready.
+/// A task keeps its class across every suspension, so a task spawned as
+/// @ref priority::critical is also woken ahead of the others by its timers,
+/// sockets and locks. Tasks spawned without a class inherit the class of
+/// the task that spawned them.
+///
+/// To keep the less urgent classes from starving, a lane that has been
+/// passed over @ref PRIORITY_AGING_LIMIT times in a row while it had tasks
+/// waiting is served next.
+enum class priority : std::uint8_t {
+    /// Latency-sensitive work, such as heartbeats and control messages
+    critical,
+    /// The default class
+    normal,
+    /// Bulk work that only needs to make progress eventually
+    background,
+};
+
+/// @brief Number of tasks an executor takes from more urgent lanes before it
+/// takes one from a lane that has been waiting
+/// @ingroup spawn_grp
+inline constexpr std::uint32_t PRIORITY_AGING_LIMIT = 32;
+
+namespace detail {
+
+// Number of run queues, one for each priority class
+inline constexpr std::size_t PRIORITY_LANES = 3;
+
+inline constexpr std::size_t lane_of(priority prio) {
+    return static_cast<std::size_t>(prio);
+}
+
+} // namespace detail
+
+} // namespace crasy
+
+#endif
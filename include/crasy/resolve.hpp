@@ -5,10 +5,12 @@
 #include <crasy/config.hpp>
 // clang-format on
 
+#include <crasy/cancel.hpp>
 #include <crasy/endpoint.hpp>
 #include <crasy/future.hpp>
 #include <crasy/result.hpp>
 
+#include <stop_token>
 #include <string_view>
 
 namespace crasy {
@@ -34,6 +36,47 @@ CRASY_API future<result<std::vector<ipv4_address>>> resolve_v4(
 CRASY_API future<result<std::vector<ipv6_address>>> resolve_v6(
     std::string_view host);
 
+/// @ingroup resolve_grp
+///
+/// The overloads taking a stop token fail with
+/// `asio::error::operation_aborted` once stop is requested on it; see
+/// @ref with_cancellation. Since the system resolver cannot be interrupted,
+/// a cancelled lookup still only fails once the resolver returns.
+inline future<result<ip_address>> resolve_one(
+    std::string_view host, std::stop_token stop) {
+    return with_cancellation(resolve_one(host), std::move(stop));
+}
+
+/// @ingroup resolve_grp
+inline future<result<ipv4_address>> resolve_one_v4(
+    std::string_view host, std::stop_token stop) {
+    return with_cancellation(resolve_one_v4(host), std::move(stop));
+}
+
+/// @ingroup resolve_grp
+inline future<result<ipv6_address>> resolve_one_v6(
+    std::string_view host, std::stop_token stop) {
+    return with_cancellation(resolve_one_v6(host), std::move(stop));
+}
+
+/// @ingroup resolve_grp
+inline future<result<std::vector<ip_address>>> resolve(
+    std::string_view host, std::stop_token stop) {
+    return with_cancellation(resolve(host), std::move(stop));
+}
+
+/// @ingroup resolve_grp
+inline future<result<std::vector<ipv4_address>>> resolve_v4(
+    std::string_view host, std::stop_token stop) {
+    return with_cancellation(resolve_v4(host), std::move(stop));
+}
+
+/// @ingroup resolve_grp
+inline future<result<std::vector<ipv6_address>>> resolve_v6(
+    std::string_view host, std::stop_token stop) {
+    return with_cancellation(resolve_v6(host), std::move(stop));
+}
+
 } // namespace crasy
 
 #endif
@@ -16,6 +16,16 @@ namespace crasy {
 template <typename T, typename E = std::system_error>
 class result;
 
+namespace detail {
+
+template <typename T>
+inline constexpr bool is_result = false;
+
+template <typename T, typename E>
+inline constexpr bool is_result<result<T, E>> = true;
+
+} // namespace detail
+
 template <typename... Args>
 class ok_result_args;
 
@@ -0,0 +1,107 @@
+#ifndef CRASY_SELECT_HPP
+#define CRASY_SELECT_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <chrono>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include <crasy/future.hpp>
+#include <crasy/join.hpp>
+#include <crasy/sleep.hpp>
+
+namespace crasy {
+
+namespace detail {
+
+// Awaits the first of a set of futures to finish. The losers are taken out
+// of the join before the task resumes, and are cancelled and let go of along
+// with the awaitable.
+template <typename... Ts>
+class select_future : public join_future<join_mode::first, Ts...> {
+  public:
+    static_assert(sizeof...(Ts) > 0, "select() needs something to select");
+
+    using value_type = std::variant<join_value_t<Ts>...>;
+
+    using join_future<join_mode::first, Ts...>::join_future;
+
+    // a finished future still goes through the join, which picks the winner
+    bool await_ready() const { return false; }
+
+    value_type await_resume() {
+        this->resume();
+        return take_winner<0>(this->first());
+    }
+
+  private:
+    template <std::size_t I>
+    value_type take_winner(const future_state* winner) {
+        auto& fut = std::get<I>(this->futures_);
+        if constexpr (I + 1 < sizeof...(Ts)) {
+            if (&future_access::state(fut) != winner) {
+                return take_winner<I + 1>(winner);
+            }
+        }
+        return value_type{std::in_place_index<I>, take_value(fut)};
+    }
+};
+
+template <typename T>
+future<T> selectable(future<T>&& fut) {
+    return std::move(fut);
+}
+
+// the sleep is moved into the frame, since the one given is a temporary
+template <typename Clock>
+future<void> selectable(sleep_future<Clock> sleep) {
+    co_await sleep;
+}
+
+template <typename Awaitable>
+using selectable_t = decltype(selectable(std::declval<Awaitable>()));
+
+} // namespace detail
+
+/// @ingroup combine_grp
+/// @brief Awaits whichever of several futures finishes first
+///
+/// Returns a `std::variant` holding the result of the future that finished
+/// first, whose `index()` tells which one it was; a future of `void` yields
+/// `std::monostate`. The other futures are cancelled, as by
+/// @ref future::cancel, and let go of, each freeing itself once it has
+/// unwound, so that nothing is left waiting. Whatever a loser that finished
+/// meanwhile returned is dropped.
+///
+/// Besides futures, such as the @ref udp_socket operations, a sleep from
+/// @ref sleep_for or @ref sleep_until can be given as a branch, which is
+/// wrapped in a future of `void`. As with @ref join, no task is spawned, and
+/// cancelling the awaiting task cancels every branch.
+///
+/// ```cpp
+/// auto res = co_await crasy::select(sock.recv_from(buf, peer),
+///                                   shutdown_requested(),
+///                                   crasy::sleep_for(idle_timeout));
+/// switch (res.index()) {
+/// case 0: // a datagram, or an error, in std::get<0>(res)
+/// case 1: // shutting down
+/// case 2: // idle for too long
+/// }
+/// ```
+template <typename... Awaitables>
+detail::select_future<
+    typename detail::selectable_t<Awaitables>::return_type...>
+select(Awaitables&&... awaitables) {
+    return detail::select_future<
+        typename detail::selectable_t<Awaitables>::return_type...>{
+        detail::selectable(std::forward<Awaitables>(awaitables))...};
+}
+
+} // namespace crasy
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef CRASY_SHARD_HPP
+#define CRASY_SHARD_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <cstddef>
+
+#include <crasy/detail.hpp>
+#include <crasy/option.hpp>
+
+namespace crasy {
+
+/// @brief Returns the shard the calling task is running on
+/// @ingroup spawn_grp
+///
+/// Returns an empty option when called from a thread that is not a core
+/// thread of the executor, such as one running a blocking task. An executor
+/// in @ref executor_mode::work_stealing mode has a single shard, 0.
+CRASY_API option<std::size_t> this_shard();
+
+/// @brief Returns the number of shards of the current executor
+/// @ingroup spawn_grp
+CRASY_API std::size_t shard_count();
+
+/// @brief Moves the calling task to another shard
+/// @ingroup spawn_grp
+///
+/// Awaiting the result suspends the task and resumes it on the given shard.
+/// Sockets and timers the task created earlier stay on their own shard.
+///
+/// ```cpp
+/// co_await crasy::move_to_shard(1);
+/// ```
+CRASY_API detail::schedule_awaiter move_to_shard(std::size_t shard);
+
+} // namespace crasy
+
+#endif
@@ -58,7 +58,7 @@ class CRASY_API shared_mutex {
 
   private:
     std::atomic<std::size_t> state_{0};
-    lfqueue<std::coroutine_handle<>> suspended_;
+    lfqueue<detail::waker> suspended_;
 
     friend class shared_mutex_lock_future;
     friend class shared_mutex_lock_shared_future;
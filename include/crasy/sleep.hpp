@@ -5,23 +5,141 @@
 #include <crasy/config.hpp>
 // clang-format on
 
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wsign-conversion"
-#pragma GCC diagnostic ignored "-Wuseless-cast"
-#pragma GCC diagnostic ignored "-Wconversion"
-#endif
-#include <asio/basic_waitable_timer.hpp>
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
-
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <stop_token>
+#include <type_traits>
 
+#include <crasy/cancel.hpp>
 #include <crasy/detail.hpp>
+#include <crasy/future.hpp>
 
 namespace crasy {
 
+namespace detail {
+
+// Slack of the timers that take the executor's default
+inline constexpr std::chrono::microseconds DEFAULT_SLACK{-1};
+
+// A pending timer, embedded in the awaitable that waits on it, so that arming
+// and cancelling it allocate nothing
+struct timer_node {
+    std::chrono::steady_clock::time_point deadline;
+    waker task{};
+    // if set, called with `data` when the timer fires, instead of waking
+    // `task`; it runs on the wheel's thread, without the wheel locked
+    void (*fire)(void* data){nullptr};
+    void* data{nullptr};
+    // set while the timer is armed, and only changed under the wheel's lock
+    std::atomic<timer_wheel*> wheel{nullptr};
+    timer_node* prev{nullptr};
+    timer_node* next{nullptr};
+    // how much later than the deadline the timer may fire, or DEFAULT_SLACK
+    std::chrono::microseconds slack{0};
+    // deadline in the wheel's ticks, and where the timer sits in the wheel
+    std::uint64_t when{0};
+    std::uint8_t level{0};
+    std::uint8_t slot{0};
+    // set when the timer is expired early, which may happen before it is
+    // even armed
+    std::atomic<bool> expired{false};
+};
+
+CRASY_API void cancel_timer_slow(timer_node& node);
+
+// Fires the timer right away, waking its task, or keeps it from being armed
+// if it has not been yet. Does nothing if it has fired already.
+CRASY_API void expire_timer(timer_node& node);
+
+// Disarms the timer if it has not fired yet, or waits for its `fire` callback
+// to return if that is running
+inline void cancel_timer(timer_node& node) {
+    if (node.wheel.load(std::memory_order_acquire) != nullptr) {
+        cancel_timer_slow(node);
+    }
+}
+
+// A timer that is armed over and over, for coroutines that wait on one
+// deadline after another. Destroying it disarms it.
+class reusable_timer {
+  public:
+    reusable_timer() = default;
+    reusable_timer(const reusable_timer&) = delete;
+    reusable_timer(reusable_timer&&) = delete;
+
+    ~reusable_timer() { cancel_timer(node_); }
+
+    reusable_timer& operator=(const reusable_timer&) = delete;
+    reusable_timer& operator=(reusable_timer&&) = delete;
+
+    // Cancelling the coroutine that waits ends the wait early, and keeps
+    // the timer from being armed again
+    struct awaiter {
+        timer_node& node;
+        cancel_slot* slot{nullptr};
+        cancel_target target{&expire, &node};
+
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        bool await_suspend(std::coroutine_handle<Promise> suspended) {
+            // attached before the timer is armed, as for a sleep_future
+            slot = cancel_slot_of(suspended);
+            if (slot != nullptr && !slot->attach(target)) { return false; }
+            return add_timer(node, suspended);
+        }
+
+        void await_resume() {
+            if (slot != nullptr) { slot->detach(target); }
+        }
+    };
+
+    // Whether a wait was cancelled, after which the timer no longer waits
+    bool cancelled() const { return node_.expired.load(); }
+
+    // Waits for the deadline. The timer must not be armed already.
+    awaiter wait_until(std::chrono::steady_clock::time_point deadline,
+                       std::chrono::microseconds slack = DEFAULT_SLACK) {
+        node_.deadline = deadline;
+        node_.slack = slack;
+        return awaiter{node_};
+    }
+
+  private:
+    static void expire(void* node) {
+        expire_timer(*static_cast<timer_node*>(node));
+    }
+
+    timer_node node_;
+};
+
+// How long before its deadline a precise sleep should wake up, to spin the
+// rest of the way, as calibrated by the calling thread so far
+CRASY_API std::chrono::steady_clock::duration precise_spin_margin();
+
+// Spins until the deadline of a precise sleep. `woken` is set if the task
+// was suspended until `target`, which calibrates the margin.
+CRASY_API void finish_precise_sleep(
+    std::chrono::steady_clock::time_point deadline,
+    std::chrono::steady_clock::time_point target, bool woken);
+
+template <typename Clock, typename Dur>
+std::chrono::steady_clock::time_point to_steady(
+    const std::chrono::time_point<Clock, Dur>& time) {
+    using steady = std::chrono::steady_clock;
+    if constexpr (std::is_same_v<Clock, steady>) {
+        return std::chrono::ceil<steady::duration>(time);
+    } else {
+        return steady::now() +
+               std::chrono::ceil<steady::duration>(time - Clock::now());
+    }
+}
+
+} // namespace detail
+
 template <typename Clock>
 class sleep_future;
 
@@ -29,56 +147,245 @@ template <typename Rep, typename Period>
 sleep_future<std::chrono::high_resolution_clock> sleep_for(
     const std::chrono::duration<Rep, Period>& timeout);
 
+template <typename Rep, typename Period, typename SRep, typename SPeriod>
+sleep_future<std::chrono::high_resolution_clock> sleep_for(
+    const std::chrono::duration<Rep, Period>& timeout,
+    const std::chrono::duration<SRep, SPeriod>& slack);
+
 template <typename Clock, typename Dur>
 sleep_future<Clock> sleep_until(
     const std::chrono::time_point<Clock, Dur>& timeout);
 
+template <typename Clock, typename Dur, typename SRep, typename SPeriod>
+sleep_future<Clock> sleep_until(
+    const std::chrono::time_point<Clock, Dur>& timeout,
+    const std::chrono::duration<SRep, SPeriod>& slack);
+
+// Timers live in a timing wheel owned by the executor thread that armed
+// them, rather than in asio's timer heap, so arming and cancelling one is
+// O(1). Deadlines are kept on the steady clock; those given on another clock
+// are converted when the sleep_future is created. Destroying a sleep_future
+// that has not fired disarms it, and cancelling the future awaiting it ends
+// the sleep early.
 template <typename Clock>
 class sleep_future {
   public:
-    bool await_ready() { return done_; }
+    sleep_future(const sleep_future&) = delete;
+
+    // Only valid before the sleep_future is awaited
+    sleep_future(sleep_future&& other) noexcept {
+        assert(other.node_.wheel.load(std::memory_order_relaxed) == nullptr);
+        node_.deadline = other.node_.deadline;
+        node_.slack = other.node_.slack;
+    }
+
+    ~sleep_future() { detail::cancel_timer(node_); }
+
+    sleep_future& operator=(const sleep_future&) = delete;
+    sleep_future& operator=(sleep_future&&) = delete;
 
-    void await_suspend(std::coroutine_handle<> suspended) {
-        timer_.async_wait([this, suspended]([[maybe_unused]] auto ec) {
-            done_ = true;
-            detail::schedule_task(suspended);
-        });
+    bool await_ready() { return false; }
+
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> suspended) {
+        // attached before the timer is armed, since the task may be woken
+        // as soon as it is; a coroutine that is cancelled does not sleep
+        slot_ = detail::cancel_slot_of(suspended);
+        if (slot_ != nullptr && !slot_->attach(target_)) { return false; }
+        return detail::add_timer(node_, suspended);
     }
 
-    void await_resume() {}
+    void await_resume() {
+        if (slot_ != nullptr) { slot_->detach(target_); }
+    }
 
   private:
-    template <typename R, typename P>
-    explicit sleep_future(const std::chrono::duration<R, P>& timeout)
-        : timer_(detail::context(), timeout) {}
+    sleep_future(std::chrono::steady_clock::time_point deadline,
+                 std::chrono::microseconds slack) {
+        node_.deadline = deadline;
+        node_.slack = slack;
+    }
 
-    template <typename D>
-    explicit sleep_future(const std::chrono::time_point<Clock, D>& timeout)
-        : timer_(detail::context(), timeout) {}
+    static void expire(void* node) {
+        detail::expire_timer(*static_cast<detail::timer_node*>(node));
+    }
 
-    asio::basic_waitable_timer<Clock> timer_;
-    bool done_{false};
+    detail::timer_node node_;
+    detail::cancel_slot* slot_{nullptr};
+    detail::cancel_target target_{&expire, &node_};
 
     template <typename R, typename P>
     friend sleep_future<std::chrono::high_resolution_clock> sleep_for(
         const std::chrono::duration<R, P>&);
 
+    template <typename R, typename P, typename SR, typename SP>
+    friend sleep_future<std::chrono::high_resolution_clock> sleep_for(
+        const std::chrono::duration<R, P>&,
+        const std::chrono::duration<SR, SP>&);
+
     template <typename C, typename D>
     friend sleep_future<C> sleep_until(const std::chrono::time_point<C, D>&);
+
+    template <typename C, typename D, typename SR, typename SP>
+    friend sleep_future<C> sleep_until(const std::chrono::time_point<C, D>&,
+                                       const std::chrono::duration<SR, SP>&);
 };
 
 /// @ingroup sleep_grp
+///
+/// The timer fires with the executor's default slack; see
+/// @ref executor::builder::timer_slack.
 template <typename Rep, typename Period>
 sleep_future<std::chrono::high_resolution_clock> sleep_for(
     const std::chrono::duration<Rep, Period>& timeout) {
-    return sleep_future<std::chrono::high_resolution_clock>{timeout};
+    return sleep_future<std::chrono::high_resolution_clock>{
+        std::chrono::steady_clock::now() +
+            std::chrono::ceil<std::chrono::steady_clock::duration>(timeout),
+        detail::DEFAULT_SLACK};
+}
+
+/// @ingroup sleep_grp
+///
+/// The timer may fire up to `slack` after the timeout, which lets timers
+/// that are due around the same time fire from a single wake-up of the
+/// thread, rather than one each.
+template <typename Rep, typename Period, typename SRep, typename SPeriod>
+sleep_future<std::chrono::high_resolution_clock> sleep_for(
+    const std::chrono::duration<Rep, Period>& timeout,
+    const std::chrono::duration<SRep, SPeriod>& slack) {
+    return sleep_future<std::chrono::high_resolution_clock>{
+        std::chrono::steady_clock::now() +
+            std::chrono::ceil<std::chrono::steady_clock::duration>(timeout),
+        std::max(std::chrono::microseconds{0},
+                 std::chrono::floor<std::chrono::microseconds>(slack))};
 }
 
 /// @ingroup sleep_grp
+///
+/// The timer fires with the executor's default slack; see
+/// @ref executor::builder::timer_slack.
 template <typename Clock, typename Dur>
 sleep_future<Clock> sleep_until(
     const std::chrono::time_point<Clock, Dur>& timeout) {
-    return sleep_future<Clock>{timeout};
+    return sleep_future<Clock>{detail::to_steady(timeout),
+                               detail::DEFAULT_SLACK};
+}
+
+/// @ingroup sleep_grp
+///
+/// The timer may fire up to `slack` after the timeout, which lets timers
+/// that are due around the same time fire from a single wake-up of the
+/// thread, rather than one each.
+template <typename Clock, typename Dur, typename SRep, typename SPeriod>
+sleep_future<Clock> sleep_until(
+    const std::chrono::time_point<Clock, Dur>& timeout,
+    const std::chrono::duration<SRep, SPeriod>& slack) {
+    return sleep_future<Clock>{
+        detail::to_steady(timeout),
+        std::max(std::chrono::microseconds{0},
+                 std::chrono::floor<std::chrono::microseconds>(slack))};
+}
+
+/// @ingroup sleep_grp
+///
+/// Ends early once stop is requested on `stop`; see
+/// @ref with_cancellation.
+template <typename Rep, typename Period>
+future<void> sleep_for(const std::chrono::duration<Rep, Period>& timeout,
+                       std::stop_token stop) {
+    return with_cancellation(sleep_for(timeout), std::move(stop));
+}
+
+/// @ingroup sleep_grp
+///
+/// Ends early once stop is requested on `stop`; see
+/// @ref with_cancellation.
+template <typename Clock, typename Dur>
+future<void> sleep_until(const std::chrono::time_point<Clock, Dur>& timeout,
+                         std::stop_token stop) {
+    return with_cancellation(sleep_until(timeout), std::move(stop));
+}
+
+/// @brief Awaitable returned by @ref precise_sleep_for and
+/// @ref precise_sleep_until
+///
+/// Waits on the timing wheel until shortly before the deadline, with no
+/// slack, and spins on the thread the rest of the way. How early to wake up
+/// is calibrated on each thread from how late its earlier wake-ups were.
+class precise_sleep_future {
+  public:
+    precise_sleep_future(const precise_sleep_future&) = delete;
+
+    // Only valid before the precise_sleep_future is awaited
+    precise_sleep_future(precise_sleep_future&& other) noexcept
+        : deadline_(other.deadline_) {
+        assert(other.node_.wheel.load(std::memory_order_relaxed) == nullptr);
+    }
+
+    ~precise_sleep_future() { detail::cancel_timer(node_); }
+
+    precise_sleep_future& operator=(const precise_sleep_future&) = delete;
+    precise_sleep_future& operator=(precise_sleep_future&&) = delete;
+
+    bool await_ready() { return false; }
+
+    bool await_suspend(std::coroutine_handle<> suspended) {
+        node_.deadline = deadline_ - detail::precise_spin_margin();
+        node_.slack = std::chrono::microseconds{0};
+        // set before the timer is added, since the task may be resumed on
+        // another thread before add_timer returns
+        woken_ = true;
+        if (!detail::add_timer(node_, suspended)) {
+            woken_ = false;
+            return false;
+        }
+        return true;
+    }
+
+    void await_resume() {
+        detail::finish_precise_sleep(deadline_, node_.deadline, woken_);
+    }
+
+  private:
+    explicit precise_sleep_future(
+        std::chrono::steady_clock::time_point deadline)
+        : deadline_(deadline) {}
+
+    std::chrono::steady_clock::time_point deadline_;
+    detail::timer_node node_;
+    bool woken_{false};
+
+    template <typename R, typename P>
+    friend precise_sleep_future precise_sleep_for(
+        const std::chrono::duration<R, P>&);
+
+    template <typename C, typename D>
+    friend precise_sleep_future precise_sleep_until(
+        const std::chrono::time_point<C, D>&);
+};
+
+/// @ingroup sleep_grp
+///
+/// Sleeps with microsecond precision, for the likes of pacing packets. The
+/// last stretch of the sleep, tens of microseconds at most, is spent
+/// spinning, during which the thread runs no other tasks. The kernel may
+/// still wake the thread late by its own timer slack, unless cut with
+/// @ref executor::builder::precise_timer_slack.
+template <typename Rep, typename Period>
+precise_sleep_future precise_sleep_for(
+    const std::chrono::duration<Rep, Period>& timeout) {
+    return precise_sleep_future{
+        std::chrono::steady_clock::now() +
+        std::chrono::ceil<std::chrono::steady_clock::duration>(timeout)};
+}
+
+/// @ingroup sleep_grp
+///
+/// See @ref precise_sleep_for
+template <typename Clock, typename Dur>
+precise_sleep_future precise_sleep_until(
+    const std::chrono::time_point<Clock, Dur>& timeout) {
+    return precise_sleep_future{detail::to_steady(timeout)};
 }
 
 } // namespace crasy
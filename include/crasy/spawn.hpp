@@ -7,339 +7,317 @@
 
 #include <crasy/detail.hpp>
 #include <crasy/future.hpp>
+#include <crasy/priority.hpp>
+#include <crasy/shard.hpp>
 
-#include <mutex>
+#include <exception>
+#include <stdexcept>
 
 namespace crasy {
 
-namespace detail {
-
 template <typename T>
-class join_handle_impl {
-  public:
-    class promise_type {
-      public:
-        join_handle_impl get_return_object() {
-            return join_handle_impl{
-                std::coroutine_handle<promise_type>::from_promise(*this)};
-        }
-
-        void unhandled_exception() {
-            std::lock_guard<std::mutex> lock{mtx_};
-            ex_ = std::current_exception();
-        }
-
-        std::suspend_never initial_suspend() { return {}; }
-
-        std::suspend_always final_suspend() {
-            std::unique_lock<std::mutex> lock{mtx_};
-            if (state_ == detached) {
-                lock.unlock();
-                lock.release();
-                std::coroutine_handle<promise_type>::from_promise(*this)
-                    .destroy();
-            } else {
-                state_ = done;
-                if (suspended_) {
-                    auto suspended = suspended_;
-                    suspended_ = std::coroutine_handle<>();
-                    detail::schedule_task(suspended);
-                }
-            }
-            return {};
-        }
-
-        void return_value(T&& value) {
-            std::lock_guard<std::mutex> lock{mtx_};
-            value_.emplace(std::forward<T>(value));
-        }
-
-      private:
-        static inline constexpr char waiting = 0;
-        static inline constexpr char done = 1;
-        static inline constexpr char detached = -1;
-
-        std::mutex mtx_;
-        option<T> value_;
-        std::exception_ptr ex_{nullptr};
-        std::coroutine_handle<> suspended_;
-        char state_{waiting};
+join_handle<T> spawn(future<T> fut);
 
-        friend class join_handle_impl;
-    };
+/// @brief Handle to a spawned async task, which can be awaited for its result
+///
+/// The task's own coroutine frame holds the join state, so spawning a task
+/// costs no allocation beyond the task itself. Dropping the handle detaches
+/// the task, which then destroys itself when it finishes.
+template <typename T>
+class join_handle {
+  private:
+    using promise_type = typename future<T>::promise_type;
 
-    join_handle_impl() = default;
+  public:
+    join_handle() = default;
 
-    join_handle_impl(const join_handle_impl&) = delete;
+    join_handle(const join_handle&) = delete;
 
-    join_handle_impl(join_handle_impl&& other) : handle_(other.handle_) {
-        other.handle_ = std::coroutine_handle<>();
+    join_handle(join_handle&& other) : handle_(other.handle_) {
+        other.handle_ = std::coroutine_handle<promise_type>();
     }
 
-    ~join_handle_impl() {
+    ~join_handle() {
         if (handle_) { detach(); }
     }
 
-    join_handle_impl& operator=(const join_handle_impl&) = delete;
+    join_handle& operator=(const join_handle&) = delete;
 
-    join_handle_impl& operator=(join_handle_impl&& rhs) {
+    join_handle& operator=(join_handle&& rhs) {
         auto tmp = handle_;
         handle_ = rhs.handle_;
         rhs.handle_ = tmp;
         return *this;
     }
 
-    bool await_ready() const {
-        auto& promise = handle_.promise();
-        std::lock_guard<std::mutex> lock{promise.mtx_};
-        return promise.state_ == promise_type::done;
-    }
+    bool await_ready() const { return handle_.promise().is_done(); }
 
-    void await_suspend(std::coroutine_handle<> suspended) {
-        auto& promise = handle_.promise();
-        std::lock_guard<std::mutex> lock{promise.mtx_};
-        if (promise.state_ == promise_type::waiting) {
-            promise.suspended_ = suspended;
-        } else {
-            detail::schedule_task(suspended);
-        }
+    bool await_suspend(std::coroutine_handle<> suspended) {
+        // the task may be running on another shard, so it wakes the joiner
+        // through the executor instead of resuming it directly
+        joiner_ = detail::waker::current(suspended);
+        return handle_.promise().set_waker(joiner_);
     }
 
     T await_resume() {
         auto& promise = handle_.promise();
-        std::lock_guard<std::mutex> lock{promise.mtx_};
         if (promise.ex_ != nullptr) {
             auto ex = promise.ex_;
             promise.ex_ = nullptr;
             std::rethrow_exception(ex);
         }
-        return *std::move(promise.value_);
+        if constexpr (!std::is_same_v<T, void>) {
+            return *std::move(promise.value_);
+        }
     }
 
     void detach() {
-        auto& promise = handle_.promise();
-        std::unique_lock<std::mutex> lock{promise.mtx_};
-        if (promise.state_ == promise_type::done) {
-            lock.unlock();
-            lock.release();
-            handle_.destroy();
-        } else {
-            promise.state_ = promise_type::detached;
-        }
+        if (!handle_.promise().detach()) { handle_.destroy(); }
+        handle_ = nullptr;
     }
 
     operator bool() const { return static_cast<bool>(handle_); }
 
   private:
-    explicit join_handle_impl(std::coroutine_handle<promise_type> handle)
+    explicit join_handle(std::coroutine_handle<promise_type> handle)
         : handle_(handle) {}
 
-    std::coroutine_handle<promise_type> handle_;
-
-    friend class promise_type;
-};
-
-template <>
-class join_handle_impl<void> {
-  public:
-    class promise_type {
-      public:
-        join_handle_impl get_return_object() {
-            return join_handle_impl{
-                std::coroutine_handle<promise_type>::from_promise(*this)};
-        }
-
-        void unhandled_exception() {
-            std::lock_guard<std::mutex> lock{mtx_};
-            ex_ = std::current_exception();
-        }
-
-        std::suspend_never initial_suspend() { return {}; }
-
-        std::suspend_always final_suspend() noexcept {
-            std::unique_lock<std::mutex> lock{mtx_};
-            if (state_ == detached) {
-                lock.unlock();
-                lock.release();
-                std::coroutine_handle<promise_type>::from_promise(*this)
-                    .destroy();
-            } else {
-                state_ = done;
-                if (suspended_) {
-                    auto suspended = suspended_;
-                    suspended_ = std::coroutine_handle<>();
-                    detail::schedule_task(suspended);
-                }
-            }
-            return {};
-        }
-
-        void return_void() {}
-
-      private:
-        static inline constexpr char waiting = 0;
-        static inline constexpr char done = 1;
-        static inline constexpr char detached = -1;
-
-        std::mutex mtx_;
-        std::exception_ptr ex_{nullptr};
-        std::coroutine_handle<> suspended_;
-        char state_{waiting};
-
-        friend class join_handle_impl;
-    };
-
-    join_handle_impl() = default;
-
-    join_handle_impl(const join_handle_impl&) = delete;
-
-    join_handle_impl(join_handle_impl&& other) : handle_(other.handle_) {
-        other.handle_ = std::coroutine_handle<promise_type>();
-    }
-
-    ~join_handle_impl() {
-        if (handle_) { detach(); }
-    }
-
-    join_handle_impl& operator=(const join_handle_impl&) = delete;
-
-    join_handle_impl& operator=(join_handle_impl&& rhs) {
-        auto tmp = handle_;
-        handle_ = rhs.handle_;
-        rhs.handle_ = tmp;
-        return *this;
-    }
-
-    bool await_ready() const {
+    // Stops waiting for the task, unless it has already finished and woken
+    // the joiner. A wait that has not started yet is blocked instead, so
+    // that await_suspend() fails, and unblock_wait() then succeeds.
+    bool abandon_wait() {
         auto& promise = handle_.promise();
-        std::lock_guard<std::mutex> lock{promise.mtx_};
-        return promise.state_ == promise_type::done;
-    }
-
-    void await_suspend(std::coroutine_handle<> suspended) {
-        auto& promise = handle_.promise();
-        std::lock_guard<std::mutex> lock{promise.mtx_};
-        if (promise.state_ == promise_type::waiting) {
-            promise.suspended_ = suspended;
-        } else {
-            detail::schedule_task(suspended);
+        // the state only ever moves from running to waited on to done, so
+        // this goes around at most twice
+        for (;;) {
+            if (promise.clear_waker(joiner_)) { return true; }
+            if (promise.set_waker(blocked())) { return false; }
+            if (promise.is_done()) { return false; }
         }
     }
 
-    void await_resume() {
-        auto& promise = handle_.promise();
-        std::lock_guard<std::mutex> lock{promise.mtx_};
-        if (promise.ex_ != nullptr) {
-            auto ex = promise.ex_;
-            promise.ex_ = nullptr;
-            std::rethrow_exception(ex);
-        }
-    }
+    // Takes back the block of abandon_wait(), if the task has not finished
+    // since, so that the handle can be awaited again
+    bool unblock_wait() { return handle_.promise().clear_waker(blocked()); }
 
-    void detach() {
-        auto& promise = handle_.promise();
-        std::unique_lock<std::mutex> lock{promise.mtx_};
-        if (promise.state_ == promise_type::done) {
-            lock.unlock();
-            lock.release();
-            handle_.destroy();
-        } else {
-            promise.state_ = promise_type::detached;
-        }
+    // Stands in for the joiner of a blocked wait, and does nothing if the
+    // task finishes meanwhile
+    static const detail::waker& blocked() {
+        static const detail::waker marker{std::noop_coroutine()};
+        return marker;
     }
 
-    operator bool() const { return static_cast<bool>(handle_); }
-
-  private:
-    explicit join_handle_impl(std::coroutine_handle<promise_type> handle)
-        : handle_(handle) {}
-
     std::coroutine_handle<promise_type> handle_;
+    detail::waker joiner_;
 
-    friend class promise_type;
+    template <typename U>
+    friend join_handle<U> spawn(future<U> fut);
+    template <typename>
+    friend class detail::timeout_future;
 };
 
-} // namespace detail
-
+/// @brief Spawns a new async task
+/// @ingroup spawn_grp
 template <typename T>
-class join_handle;
+join_handle<T> spawn(future<T> fut) {
+    return join_handle<T>{std::move(fut).into_handle()};
+}
 
+/// @brief Spawns a new async task that nobody will wait for
+/// @ingroup spawn_grp
+///
+/// This is the cheapest way to run a fire-and-forget task. The task destroys
+/// itself when it finishes, and any exception it throws is discarded.
 template <typename T>
-join_handle<T> spawn(future<T> fut);
+void spawn_detached(future<T> fut) {
+    auto handle = std::move(fut).into_handle();
+    if (!handle.promise().detach()) { handle.destroy(); }
+}
 
-template <typename T>
-class join_handle {
-  public:
-    join_handle() = default;
-    join_handle(const join_handle&) = delete;
-    join_handle(join_handle&&) = default;
-    ~join_handle() = default;
-    join_handle& operator=(const join_handle&) = delete;
-    join_handle& operator=(join_handle&&) = default;
+namespace detail {
 
-    bool await_ready() const { return handle_.await_ready(); }
+template <typename T>
+inline constexpr bool is_future = false;
 
-    void await_suspend(std::coroutine_handle<> suspended) {
-        return handle_.await_suspend(suspended);
-    }
+template <typename T>
+inline constexpr bool is_future<future<T>> = true;
 
-    T await_resume() {
-        if constexpr (std::is_same_v<T, void>) {
-            handle_.await_resume();
-        } else {
-            return handle_.await_resume();
+// Queues the future that stayed suspended at its start once the callable
+// that created it returns, or throws, in which case whoever owned it has let
+// go of it and it unwinds on the executor
+class deferred_start {
+  public:
+    deferred_start(std::size_t shard, priority prio)
+        : shard_(shard), prio_(prio) {
+        if (!in_executor_context()) {
+            throw std::runtime_error(
+                "attempt to execute async task outside of executor context");
         }
+        defer_next_start();
     }
 
-    void detach() { handle_.detach(); }
+    deferred_start(const deferred_start&) = delete;
+    deferred_start& operator=(const deferred_start&) = delete;
 
-    operator bool() const { return static_cast<bool>(handle_); }
+    ~deferred_start() {
+        if (auto handle = take_deferred_start()) {
+            schedule_task(handle, shard_, prio_);
+        }
+    }
 
   private:
-    explicit join_handle(detail::join_handle_impl<T> handle)
-        : handle_(std::move(handle)) {}
-
-    detail::join_handle_impl<T> handle_;
-
-    template <typename U>
-    friend join_handle<U> spawn(future<U> fut);
+    std::size_t shard_;
+    priority prio_;
 };
 
-/// @brief Spawns a new async task
-/// @ingroup spawn_grp
-template <typename T>
-join_handle<T> spawn(future<T> fut) {
-    return join_handle<T>{[](future<T> f) -> detail::join_handle_impl<T> {
-        if constexpr (std::is_same_v<T, void>) {
-            co_await f;
-            co_return;
-        } else {
-            co_return co_await f;
-        }
-    }(std::move(fut))};
-}
-
-/// @brief Spawns a new async task
-/// @ingroup spawn_grp
+// Turns a callable into a future that is queued on the executor rather than
+// run by the caller. A callable returning a future is invoked right away,
+// and the future's own coroutine is queued from its start, so it is the only
+// frame. Anything else is wrapped in a future that queues itself first.
 template <typename F>
-auto spawn(F&& func) {
+auto lazy_future(std::size_t shard, priority prio, F&& func) {
     static constexpr auto is_async = requires(decltype(func()) ret) {
         { ret.await_ready() } -> std::same_as<bool>;
         ret.await_suspend(std::coroutine_handle<>());
         ret.await_resume();
     };
-    if constexpr (is_async) { return spawn(func()); }
-    else {
-        using ret_t = decltype(func());
-        return spawn([func = std::forward<F>(func)]() -> future<ret_t> {
+    using ret_t = decltype(func());
+    if constexpr (is_future<ret_t>) {
+        deferred_start start{shard, prio};
+        return func();
+    } else if constexpr (is_async) {
+        using value_t = decltype(std::declval<ret_t&>().await_resume());
+        return [](std::decay_t<F> f, std::size_t sh,
+                  priority pr) -> future<value_t> {
+            co_await schedule_awaiter{sh, pr};
+            if constexpr (std::is_same_v<value_t, void>) {
+                co_await f();
+            } else {
+                co_return co_await f();
+            }
+        }(std::forward<F>(func), shard, prio);
+    } else {
+        return [](std::decay_t<F> f, std::size_t sh,
+                  priority pr) -> future<ret_t> {
+            co_await schedule_awaiter{sh, pr};
             if constexpr (std::is_same_v<ret_t, void>) {
-                func();
-                co_return;
+                f();
             } else {
-                co_return func();
+                co_return f();
             }
-        }());
+        }(std::forward<F>(func), shard, prio);
+    }
+}
+
+} // namespace detail
+
+/// @brief Spawns a new async task
+/// @ingroup spawn_grp
+///
+/// Unlike @ref spawn(future<T>), the new task does not run on the caller
+/// until it first suspends. It is queued on the executor first, so that any
+/// idle core thread can pick it up. In @ref executor_mode::sharded mode, the
+/// task stays on the caller's shard. The task inherits the caller's
+/// @ref priority.
+///
+/// A callable returning a @ref future is invoked by the caller, which only
+/// creates the future's coroutine, and that coroutine is the task itself.
+/// The callable is gone by the time the task runs, so a coroutine lambda
+/// must not use its captures; whatever the task needs is passed to a
+/// coroutine function as its parameters. Any other callable is kept by the
+/// task and invoked on the executor.
+///
+/// ```cpp
+/// crasy::spawn([conn = std::move(conn)]() mutable {
+///     return serve(std::move(conn));
+/// });
+/// ```
+template <typename F>
+auto spawn(F&& func) {
+    return spawn(detail::lazy_future(
+        detail::NO_SHARD, detail::current_priority(), std::forward<F>(func)));
+}
+
+/// @brief Spawns a new async task with the given priority
+/// @ingroup spawn_grp
+///
+/// Like @ref spawn(F&&), but the task is queued, and woken from then on, in
+/// the lane of `prio` rather than that of the caller.
+///
+/// ```cpp
+/// crasy::spawn(crasy::priority::critical, send_heartbeats);
+/// crasy::spawn(crasy::priority::background, compact_storage);
+/// ```
+template <typename F>
+auto spawn(priority prio, F&& func) {
+    return spawn(
+        detail::lazy_future(detail::NO_SHARD, prio, std::forward<F>(func)));
+}
+
+/// @brief Spawns a new async task that nobody will wait for
+/// @ingroup spawn_grp
+///
+/// Like @ref spawn(F&&), but without a join handle, as with
+/// @ref spawn_detached(future<T>).
+template <typename F>
+void spawn_detached(F&& func) {
+    spawn_detached(detail::lazy_future(
+        detail::NO_SHARD, detail::current_priority(), std::forward<F>(func)));
+}
+
+/// @brief Spawns a new async task with the given priority that nobody will
+/// wait for
+/// @ingroup spawn_grp
+///
+/// Like @ref spawn(priority, F&&), but without a join handle.
+template <typename F>
+void spawn_detached(priority prio, F&& func) {
+    spawn_detached(
+        detail::lazy_future(detail::NO_SHARD, prio, std::forward<F>(func)));
+}
+
+/// @brief Spawns a new async task on the given shard
+/// @ingroup spawn_grp
+///
+/// This is how work is handed from one shard to another in
+/// @ref executor_mode::sharded mode. The task only starts on a core thread
+/// of that shard, so any sockets or timers it creates live there.
+template <typename F>
+auto spawn_on(std::size_t shard, F&& func) {
+    if (shard >= shard_count()) {
+        throw std::out_of_range("shard index out of range");
+    }
+    return spawn(detail::lazy_future(shard, detail::current_priority(),
+                                     std::forward<F>(func)));
+}
+
+/// @brief Spawns a new async task that never leaves the calling thread
+/// @ingroup spawn_grp
+///
+/// The task may hold state that is not thread-safe, since it is only ever
+/// resumed by the thread that spawned it. Only a @ref local_executor or a
+/// core thread of an @ref executor in @ref executor_mode::sharded mode can
+/// make that promise; anywhere else this throws `std::logic_error`.
+template <typename T>
+join_handle<T> spawn_local(future<T> fut) {
+    if (!detail::tasks_stay_on_thread()) {
+        throw std::logic_error("spawn_local requires a thread-local executor");
+    }
+    return spawn(std::move(fut));
+}
+
+/// @brief Spawns a new async task that never leaves the calling thread
+/// @ingroup spawn_grp
+///
+/// Like @ref spawn_local(future<T>), but the task is queued rather than run
+/// by the caller until it first suspends, as with @ref spawn(F&&).
+template <typename F>
+auto spawn_local(F&& func) {
+    if (!detail::tasks_stay_on_thread()) {
+        throw std::logic_error("spawn_local requires a thread-local executor");
     }
+    return spawn(detail::lazy_future(
+        detail::NO_SHARD, detail::current_priority(), std::forward<F>(func)));
 }
 
 } // namespace crasy
@@ -6,143 +6,128 @@
 // clang-format on
 
 #include <crasy/detail.hpp>
+#include <crasy/frame_pool.hpp>
 #include <crasy/future.hpp>
 
-#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 namespace crasy {
 
 template <typename T>
 class blocking_join_handle;
 
-template <typename F>
-blocking_join_handle<decltype(std::declval<F>()())> spawn_blocking(F&& func);
+namespace detail {
 
+// Shared state of a blocking task and its join handle. States come from the
+// frame pool, so they are recycled rather than going through the heap, and
+// small callables are stored inline.
 template <typename T>
-class blocking_join_handle {
+class blocking_state : public pooled_promise {
   public:
-    blocking_join_handle() = default;
-
-    blocking_join_handle(const blocking_join_handle&) = delete;
-
-    blocking_join_handle(blocking_join_handle&& other) : state_(other.state_) {
-        other.state_ = nullptr;
-    }
-
-    ~blocking_join_handle() {
-        if (state_ != nullptr) { detach(); }
-    }
-
-    blocking_join_handle& operator=(const blocking_join_handle&) = delete;
-
-    blocking_join_handle& operator=(blocking_join_handle&& rhs) {
-        std::swap(state_, rhs.state_);
-        return *this;
-    }
-
-    bool await_ready() {
-        std::lock_guard<std::mutex> lock{state_->mtx};
-        return state_->state == 1;
-    }
+    // callables up to this size are stored in the state itself
+    static inline constexpr std::size_t INLINE_SIZE = 48;
 
-    void await_suspend(std::coroutine_handle<> suspended) {
-        std::lock_guard<std::mutex> lock{state_->mtx};
-        if (state_->state == 1) {
-            detail::schedule_task(suspended);
+    template <typename F>
+    explicit blocking_state(F&& func) {
+        using func_t = std::decay_t<F>;
+        if constexpr (sizeof(func_t) <= INLINE_SIZE &&
+                      alignof(func_t) <= alignof(std::max_align_t)) {
+            new (&storage_) func_t(std::forward<F>(func));
+            invoke_ = [](blocking_state& state, bool run) {
+                auto& fn = *std::launder(reinterpret_cast<func_t*>(
+                    &state.storage_));
+                if (run) { state.invoke(fn); }
+                fn.~func_t();
+            };
         } else {
-            state_->suspended = suspended;
+            new (&storage_) func_t*(new func_t(std::forward<F>(func)));
+            invoke_ = [](blocking_state& state, bool run) {
+                auto fn = *std::launder(reinterpret_cast<func_t**>(
+                    &state.storage_));
+                if (run) { state.invoke(*fn); }
+                delete fn;
+            };
         }
     }
 
-    T await_resume() {
-        std::lock_guard<std::mutex> lock{state_->mtx};
-        return *std::move(state_->ret);
-    }
+    blocking_state(const blocking_state&) = delete;
+    blocking_state(blocking_state&&) = delete;
+    ~blocking_state() = default;
+    blocking_state& operator=(const blocking_state&) = delete;
+    blocking_state& operator=(blocking_state&&) = delete;
 
-    void detach() {
-        std::unique_lock<std::mutex> lock{state_->mtx};
-        if (state_->state == 1) {
-            lock.unlock();
-            lock.release();
-            delete state_;
-        } else {
-            state_->state = -1;
-        }
-        state_ = nullptr;
+    // entry point for the blocking thread
+    static void run(void* state) {
+        auto self = static_cast<blocking_state*>(state);
+        self->invoke_(*self, true);
+        self->finish();
     }
 
-    operator bool() const { return state_ != nullptr; }
+    // Frees a state whose task never made it onto the blocking pool
+    static void discard(void* state) {
+        auto self = static_cast<blocking_state*>(state);
+        self->invoke_(*self, false);
+        delete self;
+    }
 
   private:
-    struct state_base {
-        state_base() = default;
-        state_base(const state_base&) = delete;
-        state_base(state_base&&) = delete;
-        virtual ~state_base() = default;
-        state_base& operator=(const state_base&) = delete;
-        state_base& operator=(state_base&&) = delete;
-
-        virtual void call() = 0;
-
-        std::mutex mtx;
-        option<T> ret;
-        std::exception_ptr ex{nullptr};
-        std::coroutine_handle<> suspended;
-        char state{0};
-    };
+    // the task is running, and nobody is waiting for it
+    static inline constexpr char waiting = 0;
+    // the task is running, and `suspended_` is waiting for it
+    static inline constexpr char awaited = 1;
+    // the task has finished
+    static inline constexpr char done = 2;
+    // the task is running, and deletes its state when it finishes
+    static inline constexpr char detached = -1;
 
     template <typename F>
-    struct state_t : state_base {
-        F func;
-
-        state_t(F&& f) : func(std::forward<F>(f)) {}
-        state_t(const state_t&) = delete;
-        state_t(state_t&&) = delete;
-        ~state_t() override = default;
-        state_t& operator=(const state_t&) = delete;
-        state_t& operator=(state_t&&) = delete;
-
-        void call() override {
-            std::coroutine_handle<> susp;
-            char st = 0;
-            try {
-                auto&& tmp = func();
-                std::lock_guard<std::mutex> lock{this->mtx};
-                this->ret.emplace(std::forward<T>(tmp));
-                susp = this->suspended;
-                this->suspended = std::coroutine_handle<>();
-                st = this->state;
-                this->state = 1;
-            } catch (...) {
-                std::lock_guard<std::mutex> lock{this->mtx};
-                this->ex = std::current_exception();
-                susp = this->suspended;
-                this->suspended = std::coroutine_handle();
-                st = this->state;
-                this->state = 1;
+    void invoke(F& func) {
+        try {
+            if constexpr (std::is_same_v<T, void>) {
+                func();
+            } else {
+                ret_.emplace(func());
             }
-            if (susp) { detail::schedule_task(susp); }
-            if (st == -1) { delete this; }
+        } catch (...) {
+            ex_ = std::current_exception();
         }
-    };
-
-    static void run(void* state) {
-        reinterpret_cast<state_base*>(state)->call();
     }
 
-    explicit blocking_join_handle(state_base& state) : state_(&state) {
-        detail::run_blocking(&run, state_);
+    void finish() {
+        auto st = state_.exchange(done, std::memory_order_acq_rel);
+        if (st == awaited) {
+            suspended_.wake();
+        } else if (st == detached) {
+            delete this;
+        }
     }
 
-    state_base* state_{nullptr};
+    struct empty {};
 
-    template <typename F>
-    friend blocking_join_handle<decltype(std::declval<F>()())> spawn_blocking(
-        F&&);
+    alignas(std::max_align_t) std::byte storage_[INLINE_SIZE];
+    // runs the callable, unless told not to, and destroys it
+    void (*invoke_)(blocking_state&, bool run);
+    std::conditional_t<std::is_same_v<T, void>, empty, option<T>> ret_;
+    std::exception_ptr ex_{nullptr};
+    waker suspended_;
+    std::atomic<char> state_{waiting};
+
+    friend class blocking_join_handle<T>;
 };
 
-template <>
-class blocking_join_handle<void> {
+} // namespace detail
+
+template <typename T>
+class blocking_join_handle {
+  private:
+    using state_t = detail::blocking_state<T>;
+
   public:
     blocking_join_handle() = default;
 
@@ -164,99 +149,57 @@ class blocking_join_handle<void> {
     }
 
     bool await_ready() {
-        std::lock_guard<std::mutex> lock{state_->mtx};
-        return state_->state == 1;
+        return state_->state_.load(std::memory_order_acquire) ==
+               state_t::done;
     }
 
-    void await_suspend(std::coroutine_handle<> suspended) {
-        std::lock_guard<std::mutex> lock{state_->mtx};
-        if (state_->state == 1) {
-            detail::schedule_task(suspended);
-        } else {
-            state_->suspended = suspended;
-        }
+    bool await_suspend(std::coroutine_handle<> suspended) {
+        state_->suspended_ = detail::waker::current(suspended);
+        // fails if the task finished in the meantime, in which case the
+        // awaiter carries on without suspending
+        auto state = state_t::waiting;
+        return state_->state_.compare_exchange_strong(
+            state, state_t::awaited, std::memory_order_acq_rel);
     }
 
-    void await_resume() {}
+    T await_resume() {
+        if (state_->ex_ != nullptr) {
+            auto ex = state_->ex_;
+            state_->ex_ = nullptr;
+            std::rethrow_exception(ex);
+        }
+        if constexpr (!std::is_same_v<T, void>) {
+            return *std::move(state_->ret_);
+        }
+    }
 
     void detach() {
-        std::unique_lock<std::mutex> lock{state_->mtx};
-        if (state_->state == 1) {
-            lock.unlock();
-            lock.release();
-            delete state_;
-        } else {
-            state_->state = -1;
+        auto state = state_->state_.load(std::memory_order_acquire);
+        while (state != state_t::done) {
+            if (state_->state_.compare_exchange_weak(
+                    state, state_t::detached, std::memory_order_acq_rel)) {
+                // the task deletes its state when it finishes
+                state_ = nullptr;
+                return;
+            }
         }
+        delete state_;
         state_ = nullptr;
     }
 
     operator bool() const { return state_ != nullptr; }
 
   private:
-    struct state_base {
-        state_base() = default;
-        state_base(const state_base&) = delete;
-        state_base(state_base&&) = delete;
-        virtual ~state_base() = default;
-        state_base& operator=(const state_base&) = delete;
-        state_base& operator=(state_base&&) = delete;
-
-        virtual void call() = 0;
-
-        std::mutex mtx;
-        std::exception_ptr ex{nullptr};
-        std::coroutine_handle<> suspended;
-        char state{0};
-    };
-
-    template <typename F>
-    struct state_t : state_base {
-        F func;
-
-        state_t(F&& f) : func(std::forward<F>(f)) {}
-        state_t(const state_t&) = delete;
-        state_t(state_t&&) = delete;
-        ~state_t() override = default;
-        state_t& operator=(const state_t&) = delete;
-        state_t& operator=(state_t&&) = delete;
-
-        void call() override {
-            std::coroutine_handle<> susp;
-            char st = 0;
-            try {
-                func();
-                std::lock_guard<std::mutex> lock{this->mtx};
-                susp = this->suspended;
-                this->suspended = std::coroutine_handle<>();
-                st = this->state;
-                this->state = 1;
-            } catch (...) {
-                std::lock_guard<std::mutex> lock{this->mtx};
-                this->ex = std::current_exception();
-                susp = this->suspended;
-                this->suspended = std::coroutine_handle();
-                st = this->state;
-                this->state = 1;
-            }
-            if (susp) { detail::schedule_task(susp); }
-            if (st == -1) { delete this; }
-        }
-    };
-
-    static void run(void* state) {
-        reinterpret_cast<state_base*>(state)->call();
-    }
-
-    explicit blocking_join_handle(state_base& state) : state_(&state) {
-        detail::run_blocking(&run, state_);
-    }
+    explicit blocking_join_handle(state_t& state) : state_(&state) {}
 
-    state_base* state_{nullptr};
+    state_t* state_{nullptr};
 
     template <typename F>
     friend blocking_join_handle<decltype(std::declval<F>()())> spawn_blocking(
         F&&);
+
+    template <typename Range, typename OutputIt>
+    friend OutputIt spawn_blocking_batch(Range&&, OutputIt);
 };
 
 /// @brief Spawns a new blocking task
@@ -264,9 +207,104 @@ class blocking_join_handle<void> {
 template <typename F>
 blocking_join_handle<decltype(std::declval<F>()())> spawn_blocking(F&& func) {
     using ret_t = decltype(func());
+    using state_t = detail::blocking_state<ret_t>;
+    auto state = new state_t(std::forward<F>(func));
+    try {
+        detail::run_blocking(&state_t::run, state);
+    } catch (...) {
+        state_t::discard(state);
+        throw;
+    }
+    return blocking_join_handle<ret_t>{*state};
+}
+
+namespace detail {
+
+// Number of blocking tasks of a batch queued together, whose states are
+// gathered on the stack
+inline constexpr std::size_t BLOCKING_BATCH_CHUNK = 256;
+
+} // namespace detail
+
+/// @brief Spawns a blocking task for each callable in a range, writing
+/// their join handles to `out`
+/// @ingroup spawn_grp
+///
+/// The tasks are queued up to 256 at a time, with a single wake-up of the
+/// blocking pool each, which makes this much cheaper than calling
+/// @ref spawn_blocking in a loop for many small jobs. Nothing is allocated
+/// besides the tasks themselves and whatever `out` allocates. The callables
+/// are moved out of the range if it is an rvalue, and copied otherwise. The
+/// join handles are written in the same order as the range, and the
+/// iterator past the last one is returned.
+template <typename Range, typename OutputIt>
+OutputIt spawn_blocking_batch(Range&& funcs, OutputIt out) {
+    using func_t = decltype(*std::begin(funcs));
+    using ret_t = decltype(std::declval<func_t>()());
+    using state_t = detail::blocking_state<ret_t>;
     using handle_t = blocking_join_handle<ret_t>;
-    using state_t = typename handle_t::state_t<F>;
-    return handle_t{*new state_t(std::forward<F>(func))};
+
+    void* states[detail::BLOCKING_BATCH_CHUNK];
+    std::size_t count = 0;
+    auto discard = [&] {
+        for (std::size_t i = 0; i < count; ++i) { state_t::discard(states[i]); }
+    };
+    auto submit = [&] {
+        try {
+            detail::run_blocking(&state_t::run, states, count);
+        } catch (...) {
+            discard();
+            throw;
+        }
+        std::size_t i = 0;
+        try {
+            for (; i < count; ++i) {
+                *out = handle_t{*static_cast<state_t*>(states[i])};
+                ++out;
+            }
+        } catch (...) {
+            // the tasks that are left without handles are detached
+            for (++i; i < count; ++i) {
+                static_cast<void>(handle_t{*static_cast<state_t*>(states[i])});
+            }
+            throw;
+        }
+        count = 0;
+    };
+    for (auto&& func : funcs) {
+        try {
+            if constexpr (std::is_rvalue_reference_v<Range&&>) {
+                states[count] = new state_t(std::move(func));
+            } else {
+                states[count] = new state_t(func);
+            }
+        } catch (...) {
+            discard();
+            throw;
+        }
+        if (++count == detail::BLOCKING_BATCH_CHUNK) { submit(); }
+    }
+    if (count != 0) { submit(); }
+    return out;
+}
+
+/// @brief Spawns a blocking task for each callable in a range
+/// @ingroup spawn_grp
+///
+/// Like @ref spawn_blocking_batch(Range&&, OutputIt), but returns the join
+/// handles in a vector, in the same order as the range.
+template <typename Range>
+auto spawn_blocking_batch(Range&& funcs) {
+    using func_t = decltype(*std::begin(funcs));
+    using ret_t = decltype(std::declval<func_t>()());
+
+    std::vector<blocking_join_handle<ret_t>> handles;
+    if constexpr (requires { std::size(funcs); }) {
+        handles.reserve(std::size(funcs));
+    }
+    spawn_blocking_batch(std::forward<Range>(funcs),
+                         std::back_inserter(handles));
+    return handles;
 }
 
 } // namespace crasy
@@ -7,6 +7,9 @@
 
 #include <crasy/future.hpp>
 
+#include <atomic>
+#include <cstdint>
+
 namespace crasy {
 
 template <typename T>
@@ -14,7 +17,31 @@ class stream {
   public:
     using yield_type = T;
 
-    class promise_type {
+    class promise_type : public detail::cancellable_promise {
+      private:
+        // Suspends the producer after a value is yielded or the stream ends,
+        // and hands control straight to a waiting consumer, if any, through
+        // symmetric transfer. A producer whose stream has been dropped
+        // destroys itself instead.
+        struct yield_awaiter {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<promise_type> handle) noexcept {
+                auto suspended = handle.promise().state_.exchange(
+                    yielded, std::memory_order_acq_rel);
+                if (suspended == dropped) {
+                    handle.destroy();
+                    return std::noop_coroutine();
+                }
+                if (suspended == running) { return std::noop_coroutine(); }
+                return std::coroutine_handle<>::from_address(
+                    reinterpret_cast<void*>(suspended));
+            }
+
+            void await_resume() noexcept {}
+        };
+
       public:
         stream get_return_object() {
             return stream(
@@ -25,31 +52,47 @@ class stream {
 
         std::suspend_never initial_suspend() { return {}; }
 
-        std::suspend_always final_suspend() {
+        yield_awaiter final_suspend() noexcept {
             done_ = true;
-            if (suspended_) {
-                auto suspended = suspended_;
-                suspended_ = std::coroutine_handle<>();
-                detail::schedule_task(suspended);
-            }
             return {};
         }
 
-        void yield_value(T&& value) {
+        yield_awaiter yield_value(T&& value) {
             value_.emplace(std::forward<T>(value));
-            if (suspended_) {
-                auto suspended = suspended_;
-                suspended_ = std::coroutine_handle<>();
-                detail::schedule_task(suspended);
-            }
+            return {};
         }
 
         void return_void() {}
 
+        // Lets go of the producer for good. One that is suspended on
+        // something other than a yield, or running on another thread, is
+        // cancelled, and destroys itself once it yields or finishes.
+        void release(std::coroutine_handle<promise_type> self) {
+            // cancelled first, since the producer may destroy itself as
+            // soon as it sees the stream dropped
+            cancel();
+            auto state = state_.exchange(dropped, std::memory_order_acq_rel);
+            if (state == yielded || state == consumed) { self.destroy(); }
+        }
+
       private:
+        // the producer is running, or suspended on something other than a
+        // yield
+        static inline constexpr std::uintptr_t running = 0;
+        // the producer is suspended on a yield, or finished, and the consumer
+        // has not yet taken the result
+        static inline constexpr std::uintptr_t yielded = 1;
+        // the producer is suspended on a yield, and the consumer has taken
+        // the value
+        static inline constexpr std::uintptr_t consumed = 2;
+        // the stream has been dropped while the producer was not suspended
+        // on a yield
+        static inline constexpr std::uintptr_t dropped = 3;
+
         option<T> value_;
         std::exception_ptr ex_{nullptr};
-        std::coroutine_handle<> suspended_;
+        // one of the states above, or the address of the waiting consumer
+        std::atomic<std::uintptr_t> state_{running};
         bool done_{false};
 
         template <typename>
@@ -65,8 +108,11 @@ class stream {
         other.handle_ = std::coroutine_handle<promise_type>();
     }
 
+    // A stream dropped while its producer is suspended on something other
+    // than a yield, such as a sleep or an I/O operation, cancels it, and the
+    // producer frees itself once it has unwound
     ~stream() {
-        if (handle_) { handle_.destroy(); }
+        if (handle_) { handle_.promise().release(handle_); }
     }
 
     stream& operator=(const stream&) = delete;
@@ -78,24 +124,60 @@ class stream {
         return *this;
     }
 
-    bool await_ready() {
-        auto& promise = handle_.promise();
-        return promise.done_ || promise.value_.has_value() ||
-               promise.ex_ != nullptr;
+    bool await_ready() const {
+        return handle_.promise().state_.load(std::memory_order_acquire) ==
+                   promise_type::yielded &&
+               detail::consume_budget();
     }
 
-    void await_suspend(std::coroutine_handle<> handle) {
-        handle_.promise().suspended_ = handle;
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> handle) {
+        auto& promise = handle_.promise();
+        // cancelling the consumer while it waits cancels the producer
+        promise.attach_awaiter(detail::cancel_slot_of(handle));
+        auto address = reinterpret_cast<std::uintptr_t>(handle.address());
+        auto state = promise.state_.load(std::memory_order_acquire);
+        if (state == promise_type::yielded) {
+            // the value is there, but the consumer is out of budget
+            detail::yield_task(handle);
+            return std::noop_coroutine();
+        }
+        if (state == promise_type::consumed) {
+            // the producer is parked on its last yield, so run it until it
+            // yields again, at which point it hands control back, unless
+            // the pair has been trading control for a whole budget already
+            promise.state_.store(address, std::memory_order_relaxed);
+            if (!detail::consume_budget()) {
+                detail::yield_task(handle_);
+                return std::noop_coroutine();
+            }
+            return handle_;
+        }
+        // the producer has not reached its first yield yet, and may do so on
+        // another thread while the consumer is suspending
+        if (promise.state_.compare_exchange_strong(
+                state, address, std::memory_order_acq_rel)) {
+            return std::noop_coroutine();
+        }
+        return handle;
     }
 
     option<T> await_resume() {
         auto& promise = handle_.promise();
+        promise.detach_awaiter();
+        if (!promise.done_) {
+            promise.state_.store(promise_type::consumed,
+                                 std::memory_order_relaxed);
+        }
         if (promise.ex_ != nullptr) {
             auto ex = promise.ex_;
             promise.ex_ = nullptr;
             std::rethrow_exception(ex);
         }
-        return std::move(promise.value_);
+        auto ret = std::move(promise.value_);
+        promise.value_.reset();
+        return ret;
     }
 
     template <typename F>
@@ -0,0 +1,175 @@
+#ifndef CRASY_TASK_SCOPE_HPP
+#define CRASY_TASK_SCOPE_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+#include <crasy/detail.hpp>
+#include <crasy/future.hpp>
+#include <crasy/future_set.hpp>
+#include <crasy/join.hpp>
+#include <crasy/option.hpp>
+#include <crasy/spawn.hpp>
+
+namespace crasy {
+
+class task_scope;
+
+template <typename F>
+auto scoped(F body)
+    -> future<typename std::invoke_result_t<F&, task_scope&>::return_type>;
+
+/// @brief The tasks spawned within a call to @ref scoped, which are all done
+/// by the time it returns
+///
+/// A child finished is freed the next time a child is spawned or the
+/// children are joined, rather than when the scope ends. The first child to
+/// throw has the others cancelled, as by @ref future::cancel, as soon as the
+/// scope notices, and its exception is rethrown by @ref join. Children hand
+/// their results back through what they borrow.
+class task_scope {
+  public:
+    task_scope(const task_scope&) = delete;
+    task_scope(task_scope&&) = delete;
+    task_scope& operator=(const task_scope&) = delete;
+    task_scope& operator=(task_scope&&) = delete;
+
+    /// @brief Adds a future to the scope, as a task of its own
+    ///
+    /// Like @ref spawn(future<T>), the future runs until it first suspends
+    /// before this returns.
+    void spawn(future<void> child) {
+        reap();
+        if (error_ != nullptr) { child.cancel(); }
+        children_.push(std::move(child));
+    }
+
+    /// @brief Spawns a new async task within the scope
+    ///
+    /// Like @ref spawn(F&&), a callable returning a future is invoked right
+    /// away, and the future's own coroutine is queued on the executor as the
+    /// child. The child may borrow anything that outlives the call to
+    /// @ref scoped, passed to it as parameters rather than captured.
+    template <typename F>
+    void spawn(F&& func) {
+        auto child = detail::lazy_future(detail::NO_SHARD,
+                                         detail::current_priority(),
+                                         std::forward<F>(func));
+        static_assert(std::is_same_v<decltype(child), future<void>>,
+                      "children of a task scope return nothing");
+        spawn(std::move(child));
+    }
+
+    /// @brief Awaits every child spawned so far
+    ///
+    /// Rethrows the exception of the first child to have thrown, once every
+    /// child has finished. Cancelling the awaiting task cancels every child.
+    future<void> join() {
+        bool more = true;
+        while (more) {
+            try {
+                more = co_await children_.next();
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        }
+        if (error_ != nullptr) {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+    /// @brief Cancels every child, as by @ref future::cancel, without
+    /// waiting for them
+    void cancel() { children_.cancel(); }
+
+  private:
+    task_scope() = default;
+
+    ~task_scope() = default;
+
+    // Frees the children that have finished
+    void reap() {
+        for (;;) {
+            try {
+                if (!children_.try_next()) { return; }
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        }
+    }
+
+    void fail(std::exception_ptr ex) {
+        if (error_ == nullptr) {
+            error_ = std::move(ex);
+            children_.cancel();
+        }
+    }
+
+    future_set<void> children_;
+    std::exception_ptr error_{nullptr};
+
+    template <typename F>
+    friend auto scoped(F body)
+        -> future<typename std::invoke_result_t<F&, task_scope&>::return_type>;
+};
+
+/// @ingroup spawn_grp
+/// @brief Runs `body` with a @ref task_scope, and awaits every task it
+/// spawns in the scope before returning
+///
+/// Since the children are done before this returns, they may borrow from
+/// the awaiting task's frame, unlike tasks given to @ref spawn(F&&), which
+/// must own what they capture. If `body` throws, the children are cancelled,
+/// and its exception is rethrown once they have finished, ahead of any a
+/// child threw. Otherwise, the result of `body` is returned once the
+/// children have finished, unless one of them threw. Cancelling the
+/// awaiting task cancels `body`, and the children once it returns.
+///
+/// ```cpp
+/// crasy::future<void> fetch(const key& k, record& out) {
+///     out = co_await lookup(k);
+/// }
+///
+/// std::vector<record> records(keys.size());
+/// co_await crasy::scoped(
+///     [&](crasy::task_scope& scope) -> crasy::future<void> {
+///         for (std::size_t i = 0; i < keys.size(); ++i) {
+///             scope.spawn([&, i] { return fetch(keys[i], records[i]); });
+///         }
+///         co_return;
+///     });
+/// ```
+template <typename F>
+auto scoped(F body)
+    -> future<typename std::invoke_result_t<F&, task_scope&>::return_type> {
+    using value_t = typename std::invoke_result_t<F&, task_scope&>::return_type;
+    task_scope scope;
+    std::exception_ptr ex{nullptr};
+    option<detail::join_value_t<value_t>> value;
+    try {
+        if constexpr (std::is_void_v<value_t>) {
+            co_await body(scope);
+        } else {
+            value.emplace(co_await body(scope));
+        }
+    } catch (...) {
+        ex = std::current_exception();
+        scope.cancel();
+    }
+    try {
+        co_await scope.join();
+    } catch (...) {
+        if (ex == nullptr) { ex = std::current_exception(); }
+    }
+    if (ex != nullptr) { std::rethrow_exception(ex); }
+    if constexpr (!std::is_void_v<value_t>) { co_return *std::move(value); }
+}
+
+} // namespace crasy
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef CRASY_TIMEOUT_HPP
+#define CRASY_TIMEOUT_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <chrono>
+#include <coroutine>
+#include <type_traits>
+#include <utility>
+
+#include <crasy/detail.hpp>
+#include <crasy/future.hpp>
+#include <crasy/mutex.hpp>
+#include <crasy/result.hpp>
+#include <crasy/sleep.hpp>
+#include <crasy/spawn.hpp>
+
+namespace crasy {
+
+/// @ingroup cancel_grp
+/// @brief Error of an awaitable that did not finish before its deadline
+struct timed_out {};
+
+namespace detail {
+
+template <typename T>
+inline constexpr bool is_join_handle = false;
+
+template <typename T>
+inline constexpr bool is_join_handle<join_handle<T>> = true;
+
+// Races an awaitable against a timer on the timing wheel, within the
+// awaiting task. When the timer fires first, its callback cancels a future,
+// or takes the task out of the wait on a join_handle or mutex, and the task
+// resumes with timed_out. The timer is armed before the wait starts, and one
+// that fires before a join_handle or mutex wait has started blocks it, so
+// that the task carries on without waiting. An lvalue awaitable is held by
+// reference.
+template <typename Awaitable>
+class timeout_future {
+  private:
+    using inner_type = std::remove_cvref_t<Awaitable>;
+
+    static_assert(is_future<inner_type> || is_join_handle<inner_type> ||
+                      std::is_same_v<inner_type, mutex_lock_future>,
+                  "timeout() takes a future, a join_handle or a mutex lock");
+
+  public:
+    using value_type = decltype(std::declval<inner_type&>().await_resume());
+
+    timeout_future(std::chrono::steady_clock::time_point deadline,
+                   Awaitable&& inner)
+        : inner_(std::forward<Awaitable>(inner)) {
+        node_.deadline = deadline;
+        node_.slack = DEFAULT_SLACK;
+        node_.fire = &fire;
+        node_.data = this;
+    }
+
+    timeout_future(const timeout_future&) = delete;
+    timeout_future(timeout_future&&) = delete;
+
+    ~timeout_future() { cancel_timer(node_); }
+
+    timeout_future& operator=(const timeout_future&) = delete;
+    timeout_future& operator=(timeout_future&&) = delete;
+
+    bool await_ready() { return inner_.await_ready(); }
+
+    // The task may be resumed as soon as the wait starts, so that is the
+    // last thing done here
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> suspended) {
+        suspended_ = suspended;
+        waiter_ = waker::current(suspended);
+        if (!add_timer(node_)) { fire(this); }
+        if constexpr (is_future<inner_type>) {
+            return inner_.await_suspend(suspended);
+        } else if constexpr (is_join_handle<inner_type>) {
+            if (inner_.await_suspend(suspended)) { return true; }
+            // the task has finished, or the timer blocked the wait
+            timed_out_ = inner_.unblock_wait();
+            return false;
+        } else {
+            if (inner_.suspend_unless_abandoned(suspended)) { return true; }
+            timed_out_ = true;
+            return false;
+        }
+    }
+
+    result<value_type, timed_out> await_resume() {
+        // waits for the callback, if it is running
+        cancel_timer(node_);
+        if (timed_out_) {
+            if constexpr (is_future<inner_type>) {
+                // still detaches the future from this task; whatever it
+                // finished with is dropped
+                try {
+                    static_cast<void>(inner_.await_resume());
+                } catch (...) {
+                }
+            }
+            return err(timed_out{});
+        }
+        if constexpr (std::is_same_v<value_type, void>) {
+            inner_.await_resume();
+            return ok();
+        } else {
+            return ok(inner_.await_resume());
+        }
+    }
+
+  private:
+    static void fire(void* self) {
+        auto& race = *static_cast<timeout_future*>(self);
+        if constexpr (is_future<inner_type>) {
+            // the future resumes the task once it has unwound
+            if (!race.inner_.await_ready()) {
+                race.timed_out_ = true;
+                race.inner_.cancel();
+            }
+        } else {
+            bool abandoned = false;
+            if constexpr (is_join_handle<inner_type>) {
+                abandoned = race.inner_.abandon_wait();
+            } else {
+                abandoned = race.inner_.abandon_wait(race.suspended_);
+            }
+            if (abandoned) {
+                race.timed_out_ = true;
+                race.waiter_.wake();
+            }
+        }
+    }
+
+    Awaitable inner_;
+    timer_node node_;
+    std::coroutine_handle<> suspended_;
+    waker waiter_;
+    bool timed_out_{false};
+};
+
+} // namespace detail
+
+/// @ingroup cancel_grp
+/// @brief Awaits `awaitable`, giving up on it after `limit`
+///
+/// `awaitable` may be a @ref future, such as those returned by the
+/// @ref udp_socket operations and the @ref resolve_grp "resolve functions",
+/// a @ref join_handle, or the awaitable returned by @ref mutex::lock. No task
+/// is spawned for the race: the awaiting task arms a timer, and when it
+/// fires first, the task resumes with a @ref timed_out error.
+///
+/// A future that times out is cancelled, as by @ref future::cancel, and the
+/// task resumes once it has unwound, which for an I/O operation is right
+/// away. What the future finished with is then dropped, even if it
+/// completed just as it was cancelled. A task awaited through a join_handle
+/// keeps running when the wait on it times out, and the handle can be
+/// awaited again. A mutex lock that times out is not taken.
+///
+/// An rvalue awaitable is moved into the returned awaitable, while an lvalue
+/// is awaited in place. The timer fires with the executor's default slack;
+/// see @ref executor::builder::timer_slack.
+///
+/// ```cpp
+/// auto res = co_await crasy::timeout(std::chrono::milliseconds(200),
+///                                    sock.recv_from(buf, peer));
+/// if (!res) {
+///     // no reply within 200 ms
+/// }
+/// ```
+template <typename Rep, typename Period, typename Awaitable>
+detail::timeout_future<Awaitable> timeout(
+    const std::chrono::duration<Rep, Period>& limit, Awaitable&& awaitable) {
+    return detail::timeout_future<Awaitable>{
+        std::chrono::steady_clock::now() +
+            std::chrono::ceil<std::chrono::steady_clock::duration>(limit),
+        std::forward<Awaitable>(awaitable)};
+}
+
+/// @ingroup cancel_grp
+/// @brief Awaits `awaitable`, giving up on it at `deadline`
+///
+/// See @ref timeout
+template <typename Clock, typename Dur, typename Awaitable>
+detail::timeout_future<Awaitable> timeout_at(
+    const std::chrono::time_point<Clock, Dur>& deadline,
+    Awaitable&& awaitable) {
+    return detail::timeout_future<Awaitable>{
+        detail::to_steady(deadline), std::forward<Awaitable>(awaitable)};
+}
+
+} // namespace crasy
+
+#endif
@@ -16,12 +16,14 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <crasy/cancel.hpp>
 #include <crasy/endpoint.hpp>
 #include <crasy/future.hpp>
 #include <crasy/result.hpp>
 #include <crasy/utils.hpp>
 
 #include <span>
+#include <stop_token>
 
 namespace crasy {
 
@@ -43,6 +45,16 @@ class CRASY_API udp_socket {
     future<result<void>> wait_read();
     future<result<void>> wait_write();
 
+    // Overloads taking a stop token fail with asio::error::operation_aborted
+    // once stop is requested on it; see with_cancellation()
+    future<result<void>> wait_read(std::stop_token stop) {
+        return with_cancellation(wait_read(), std::move(stop));
+    }
+
+    future<result<void>> wait_write(std::stop_token stop) {
+        return with_cancellation(wait_write(), std::move(stop));
+    }
+
     result<std::size_t> available() const;
 
     future<result<std::size_t>> send(std::span<const std::byte> buf);
@@ -74,6 +86,27 @@ class CRASY_API udp_socket {
                          peer);
     }
 
+    future<result<std::size_t>> recv(std::span<std::byte> buf,
+                                     std::stop_token stop) {
+        return with_cancellation(recv(buf), std::move(stop));
+    }
+
+    future<result<std::size_t>> recv(buffer auto& buf, std::stop_token stop) {
+        return with_cancellation(recv(buf), std::move(stop));
+    }
+
+    future<result<std::size_t>> recv_from(std::span<std::byte> buf,
+                                          endpoint& peer,
+                                          std::stop_token stop) {
+        return with_cancellation(recv_from(buf, peer), std::move(stop));
+    }
+
+    future<result<std::size_t>> recv_from(buffer auto& buf,
+                                          endpoint& peer,
+                                          std::stop_token stop) {
+        return with_cancellation(recv_from(buf, peer), std::move(stop));
+    }
+
   private:
     future<result<void>> ensure_open(bool is_v4);
 
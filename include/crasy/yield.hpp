@@ -0,0 +1,42 @@
+#ifndef CRASY_YIELD_HPP
+#define CRASY_YIELD_HPP
+
+// clang-format off
+#include <crasy/config.hpp>
+// clang-format on
+
+#include <cstdint>
+
+#include <crasy/detail.hpp>
+
+namespace crasy {
+
+/// @brief Number of awaits a task may complete without suspending before it
+/// is made to yield
+/// @ingroup spawn_grp
+///
+/// Each time the executor resumes a task, the task gets this budget. Every
+/// await on one of crasy's own awaitables, such as socket operations,
+/// @ref mutex locks and @ref stream items, uses up one unit. Once the budget
+/// is spent, the next such await yields as with @ref yield_now, even if its
+/// result is already available. This keeps a task that is flooded with
+/// ready I/O from starving other tasks and timers on its thread.
+inline constexpr std::uint32_t TASK_BUDGET = 128;
+
+/// @brief Lets the other ready tasks run before the calling task continues
+/// @ingroup spawn_grp
+///
+/// The task is queued behind every task of its @ref priority that is already
+/// ready to run, and pending I/O gets a chance to complete in the meantime.
+///
+/// ```cpp
+/// for (auto& item : items) {
+///     process(item);
+///     co_await crasy::yield_now();
+/// }
+/// ```
+inline detail::yield_awaiter yield_now() { return {}; }
+
+} // namespace crasy
+
+#endif
@@ -0,0 +1,167 @@
+#include "blocking_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <utility>
+
+namespace crasy {
+
+blocking_pool::blocking_pool(std::size_t max_threads,
+                             std::chrono::nanoseconds keep_alive,
+                             thread_options options,
+                             thread_entry entry)
+    : options_(std::move(options)), entry_(std::move(entry)),
+      max_threads_(max_threads), keep_alive_(keep_alive) {}
+
+blocking_pool::~blocking_pool() {
+    std::vector<os_thread> threads;
+    {
+        std::lock_guard<std::mutex> lock{mut_};
+        done_ = true;
+        threads = std::move(exited_);
+        for (auto& entry : threads_) {
+            if (entry.second.joinable()) {
+                threads.push_back(std::move(entry.second));
+            }
+        }
+        threads_.clear();
+    }
+    cv_.notify_all();
+    for (auto& thread : threads) { thread.join(); }
+}
+
+void blocking_pool::run(void (*func)(void*), void* const* data,
+                        std::size_t count) {
+    if (count == 0) { return; }
+    std::unique_lock<std::mutex> lock{mut_};
+    std::size_t queued = 0;
+    auto first_id = next_id_;
+    std::size_t starts = 0;
+    try {
+        for (; queued < count; ++queued) {
+            tasks_.push_back(task{func, data[queued]});
+        }
+        // register threads for the tasks that no idle thread will pick up,
+        // which are started once the lock is released
+        while (tasks_.size() > idle_ + starting_ &&
+               threads_.size() < max_threads_) {
+            threads_.emplace(next_id_++, os_thread{});
+            ++starting_;
+            ++starts;
+        }
+    } catch (...) {
+        // nothing is queued if this throws, so the caller can free the
+        // tasks; they are the last ones, since the lock is still held
+        tasks_.erase(tasks_.end() - static_cast<std::ptrdiff_t>(queued),
+                     tasks_.end());
+        for (std::size_t i = 0; i < starts; ++i) {
+            threads_.erase(first_id + i);
+        }
+        starting_ -= starts;
+        throw;
+    }
+    auto wake = std::min(count, idle_);
+    bool reap = !exited_.empty();
+    lock.unlock();
+    if (wake == 1) {
+        cv_.notify_one();
+    } else if (wake > 1) {
+        cv_.notify_all();
+    }
+    std::exception_ptr failed{nullptr};
+    for (std::size_t i = 0; i < starts; ++i) {
+        try {
+            start_thread(first_id + i);
+        } catch (...) {
+            failed = std::current_exception();
+        }
+    }
+    if (failed != nullptr) { withdraw(func, data, count, failed); }
+    if (reap) { join_exited_threads(); }
+}
+
+// Starts the thread registered under `id`, without holding mut_, since
+// starting a thread is a slow system call. The thread may run, and even
+// retire, before its handle is stored.
+void blocking_pool::start_thread(std::size_t id) {
+    os_thread thread;
+    try {
+        thread = os_thread{options_, [this, id] {
+                               entry_([this, id] { work(id); });
+                           }};
+    } catch (...) {
+        std::lock_guard<std::mutex> lock{mut_};
+        threads_.erase(id);
+        --starting_;
+        throw;
+    }
+    std::lock_guard<std::mutex> lock{mut_};
+    auto it = threads_.find(id);
+    if (it != threads_.end()) {
+        it->second = std::move(thread);
+    } else {
+        // already retired, leaving its handle to be joined
+        exited_.push_back(std::move(thread));
+    }
+}
+
+// Called when a thread for the given tasks could not be started. They stay
+// queued if other threads are left to run them. Otherwise, they are taken
+// back out and the error rethrown, so that the caller can free them, unless
+// they have all run already; a thread only retires once the queue is empty,
+// so either all of them are still queued or none are. Tasks queued by other
+// calls wait for the threads a later call starts.
+void blocking_pool::withdraw(void (*func)(void*), void* const* data,
+                             std::size_t count, std::exception_ptr error) {
+    std::unique_lock<std::mutex> lock{mut_};
+    if (!threads_.empty()) { return; }
+    auto ours = [&](const task& t) {
+        return t.func == func &&
+               std::find(data, data + count, t.data) != data + count;
+    };
+    auto removed = std::erase_if(tasks_, ours);
+    lock.unlock();
+    if (removed != 0) { std::rethrow_exception(error); }
+}
+
+void blocking_pool::join_exited_threads() {
+    std::vector<os_thread> exited;
+    {
+        std::lock_guard<std::mutex> lock{mut_};
+        exited.swap(exited_);
+    }
+    for (auto& thread : exited) { thread.join(); }
+}
+
+void blocking_pool::work(std::size_t id) {
+    std::unique_lock<std::mutex> lock{mut_};
+    --starting_;
+    for (;;) {
+        if (!tasks_.empty()) {
+            auto next = tasks_.front();
+            tasks_.pop_front();
+            lock.unlock();
+            next.func(next.data);
+            lock.lock();
+            continue;
+        }
+        if (done_) { return; }
+        ++idle_;
+        auto woken = cv_.wait_for(lock, keep_alive_, [this] {
+            return done_ || !tasks_.empty();
+        });
+        --idle_;
+        if (!woken) { break; }
+    }
+    // idle for too long, so retire; the thread is joined by the next one
+    // to start, or by the pool's destructor
+    auto self = threads_.extract(id);
+    // the handle is missing if the thread retires before it is stored, in
+    // which case whoever started it hands it to exited_
+    if (self.mapped().joinable()) {
+        exited_.push_back(std::move(self.mapped()));
+    }
+}
+
+} // namespace crasy
@@ -0,0 +1,75 @@
+#ifndef CRASY_BLOCKING_POOL_HPP
+#define CRASY_BLOCKING_POOL_HPP
+
+#include "thread.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace crasy {
+
+// Elastic pool of threads for blocking tasks, shared by the executor types.
+// Threads are started on demand, up to a cap, and exit after being idle for
+// the keep-alive. The destructor runs every queued task before joining.
+class blocking_pool {
+  public:
+    // Runs a new thread's work loop, so that the owner can set up the
+    // thread's executor context around it
+    using thread_entry = std::function<void(const std::function<void()>&)>;
+
+    blocking_pool(std::size_t max_threads,
+                  std::chrono::nanoseconds keep_alive,
+                  thread_options options,
+                  thread_entry entry);
+
+    blocking_pool(const blocking_pool&) = delete;
+    blocking_pool(blocking_pool&&) = delete;
+
+    ~blocking_pool();
+
+    blocking_pool& operator=(const blocking_pool&) = delete;
+    blocking_pool& operator=(blocking_pool&&) = delete;
+
+    void run(void (*func)(void*), void* const* data, std::size_t count);
+
+  private:
+    struct task {
+        void (*func)(void*);
+        void* data;
+    };
+
+    void start_thread(std::size_t id);
+    void withdraw(void (*func)(void*), void* const* data, std::size_t count,
+                  std::exception_ptr error);
+    void join_exited_threads();
+    void work(std::size_t id);
+
+    thread_options options_;
+    thread_entry entry_;
+    std::mutex mut_;
+    std::condition_variable cv_;
+    std::deque<task> tasks_;
+    // keyed by a serial number, since the threads may not be std::threads;
+    // a thread is added before it is started, without its handle
+    std::unordered_map<std::size_t, os_thread> threads_;
+    // threads that exited after their keep-alive, waiting to be joined
+    std::vector<os_thread> exited_;
+    std::size_t next_id_{0};
+    std::size_t max_threads_;
+    std::size_t idle_{0};
+    // threads started that have not yet picked up any work
+    std::size_t starting_{0};
+    std::chrono::nanoseconds keep_alive_;
+    bool done_{false};
+};
+
+} // namespace crasy
+
+#endif
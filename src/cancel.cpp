@@ -0,0 +1,43 @@
+#include <crasy/detail.hpp>
+#include "cpu_relax.hpp"
+
+#include <thread>
+
+namespace crasy::detail {
+
+// Spins before yielding while waiting out a cancellation, which only runs
+// the target's brief `cancel`
+inline constexpr int CANCEL_WAIT_SPINS = 64;
+
+void cancel_slot::cancel() {
+    auto state = state_.load(std::memory_order_acquire);
+    while (state != cancelled && state != busy) {
+        if (state == empty) {
+            if (state_.compare_exchange_weak(state, cancelled,
+                                             std::memory_order_acq_rel)) {
+                return;
+            }
+        } else if (state_.compare_exchange_weak(state, busy,
+                                                std::memory_order_acq_rel)) {
+            // the target stays alive until this is done, since detaching it
+            // waits for the busy marker to go
+            auto& target = *reinterpret_cast<cancel_target*>(state);
+            target.cancel(target.data);
+            state_.store(cancelled, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void cancel_slot::wait_for_cancel() const {
+    for (int spins = 0; state_.load(std::memory_order_acquire) == busy;
+         ++spins) {
+        if (spins < CANCEL_WAIT_SPINS) {
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+} // namespace crasy::detail
@@ -9,8 +9,8 @@ condition_variable_wait_future_base::condition_variable_wait_future_base(
 void condition_variable_wait_future_base::notify() {
     notified_ = true;
     auto suspended = suspended_;
-    suspended_ = std::coroutine_handle<>();
-    detail::schedule_task(suspended);
+    suspended_ = detail::waker{};
+    suspended.wake();
 }
 
 void condition_variable::notify_one() {
@@ -0,0 +1,17 @@
+#ifndef CRASY_CPU_RELAX_HPP
+#define CRASY_CPU_RELAX_HPP
+
+namespace crasy {
+
+// Tells the CPU that the thread is in a spin loop
+inline void cpu_relax() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace crasy
+
+#endif
@@ -1,8 +1,28 @@
 #include <crasy/executor.hpp>
+#include <crasy/local_executor.hpp>
+#include <crasy/priority.hpp>
+#include <crasy/shard.hpp>
+#include <crasy/spawn.hpp>
 #include <crasy/utils.hpp>
+#include <crasy/yield.hpp>
+#include "blocking_pool.hpp"
+#include "cpu_relax.hpp"
+#include "thread.hpp"
+#include "timer_wheel.hpp"
+#include "wsdeque.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
 
 #ifdef __GNUC__
 #pragma GCC diagnostic push
@@ -18,12 +38,123 @@
 
 namespace crasy {
 
+// Number of tasks a core thread runs between checks of the I/O context and
+// the injection queue, so that neither is starved by a busy local queue
+inline constexpr std::uint32_t CHECK_INTERVAL = 61;
+
+// Number of rounds a spinning thread checks the run queues between polls of
+// the I/O context, which takes a lock in work-stealing mode
+inline constexpr std::uint32_t SPIN_POLL_INTERVAL = 16;
+
+// Returns the time `dur` after `now`, or the end of time if that is too far
+// off to represent
+static std::chrono::steady_clock::time_point deadline_after(
+    std::chrono::steady_clock::time_point now, std::chrono::microseconds dur) {
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::time_point::max() - now);
+    if (dur >= left) { return std::chrono::steady_clock::time_point::max(); }
+    return now + dur;
+}
+
+struct alignas(64) executor::worker {
+    worker(executor& ex, std::size_t idx, asio::io_context* shared)
+        : exec(&ex), index(idx), rng(static_cast<std::uint32_t>(idx) + 1) {
+        if (shared != nullptr) {
+            context = shared;
+        } else {
+            // only ever run by this worker's thread. The hint of one tells
+            // asio so, which keeps it from waking other threads to share the
+            // handlers, and lets handlers posted from this thread skip the
+            // lock. Other threads still post to the context, to wake this
+            // one, and stop it on shutdown, so its locking is left on, as
+            // ASIO_CONCURRENCY_HINT_UNSAFE would turn it off.
+            own_context = std::make_unique<asio::io_context>(1);
+            context = own_context.get();
+            guard.emplace(asio::make_work_guard(*context));
+        }
+        timers =
+            std::make_unique<detail::timer_wheel>(*context, ex.timer_slack_);
+    }
+
+    std::uint32_t next_random() {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+
+    // the run queues of one priority class
+    struct lane {
+        wsdeque<std::coroutine_handle<>> tasks;
+        // tasks that yielded, run once the others in the lane and pending
+        // I/O have had a turn; only ever touched by the worker's own thread
+        std::deque<std::coroutine_handle<>> yielded;
+    };
+
+    bool has_tasks() const {
+        return std::any_of(lanes.begin(), lanes.end(),
+                           [](const lane& ln) { return !ln.tasks.empty(); });
+    }
+
+    executor* exec;
+    std::size_t index;
+    std::unique_ptr<asio::io_context> own_context;
+    asio::io_context* context;
+    option<asio::executor_work_guard<asio::io_context::executor_type>> guard;
+    // timers armed by tasks running on this worker
+    std::unique_ptr<detail::timer_wheel> timers;
+    std::array<lane, detail::PRIORITY_LANES> lanes;
+    // how many times in a row each lane was passed over while it had tasks
+    std::array<std::uint32_t, detail::PRIORITY_LANES> passed{};
+    // lane of the task last returned by next_task()
+    std::size_t current_lane{0};
+    // sharded mode only: wake-ups from other threads
+    task_inbox inbox;
+    // parking state, in sharded mode and for the block_on caller
+    std::atomic<bool> idle{false};
+    std::atomic<bool> wake_pending{false};
+    // the worker runs until this is set
+    const std::atomic<bool>* stop{nullptr};
+    // block_on caller only: bumped to wake it from park()
+    std::atomic<std::uint32_t> signal{0};
+    // only ever bumped by the worker's own thread
+    std::atomic<std::uint64_t> idle_count{0};
+    std::atomic<std::uint64_t> spin_hits{0};
+    std::atomic<std::uint64_t> parks{0};
+    std::uint32_t tick{0};
+    std::uint32_t rng;
+};
+
 static thread_local executor* g_exec = nullptr;
 
+// what is left of the running task's budget
+static thread_local std::uint32_t g_budget = TASK_BUDGET;
+
+// priority of the running task
+static thread_local priority g_priority = priority::normal;
+
+// set by defer_next_start() until a future takes it up, which then waits in
+// g_deferred for take_deferred_start()
+static thread_local bool g_defer_start = false;
+static thread_local std::coroutine_handle<> g_deferred;
+
+executor::worker*& executor::current_worker() {
+    static thread_local worker* current = nullptr;
+    return current;
+}
+
+executor::worker* executor::local_worker() const {
+    auto self = current_worker();
+    return self != nullptr && self->exec == this ? self : nullptr;
+}
+
 class exec_guard {
   public:
     explicit exec_guard(executor& exec) {
         if (g_exec == nullptr) {
+            if (detail::in_executor_context()) {
+                throw std::runtime_error("attempt to nest executors");
+            }
             root_ = true;
             g_exec = &exec;
         } else if (g_exec != &exec) {
@@ -44,155 +175,767 @@ class exec_guard {
     bool root_;
 };
 
-executor::executor() : executor(*available_cpu_cores()) {}
+// Number of core threads to start for the given configuration
+static std::size_t core_thread_count(const option<std::size_t>& count,
+                                     const std::vector<std::size_t>& cpus) {
+    if (count.has_value()) { return *count; }
+    return cpus.empty() ? *available_cpu_cores() : cpus.size();
+}
+
+executor::executor() : executor(builder()) {}
 
 executor::executor(std::size_t core_threads)
-    : executor(core_threads, core_threads) {}
+    : executor(builder().core_threads(core_threads)) {}
+
+executor::executor(std::size_t core_threads, std::size_t max_blocking_threads)
+    : executor(builder()
+                   .core_threads(core_threads)
+                   .max_blocking_threads(max_blocking_threads)) {}
 
-executor::executor(std::size_t core_threads, std::size_t blocking_threads) {
+executor::executor(std::size_t core_threads, std::size_t max_blocking_threads,
+                   executor_mode mode)
+    : executor(builder()
+                   .core_threads(core_threads)
+                   .max_blocking_threads(max_blocking_threads)
+                   .mode(mode)) {}
+
+executor::executor(std::size_t core_threads, std::size_t max_blocking_threads,
+                   executor_mode mode, park_policy parking)
+    : executor(builder()
+                   .core_threads(core_threads)
+                   .max_blocking_threads(max_blocking_threads)
+                   .mode(mode)
+                   .parking(parking)) {}
+
+executor::executor(const builder& config)
+    : mode_(config.mode_), parking_(config.parking_),
+      timer_slack_(std::max(std::chrono::microseconds{0}, config.timer_slack_)),
+      precise_timer_slack_(config.precise_timer_slack_),
+      core_guard_(asio::make_work_guard(context_)),
+      workers_built_(static_cast<std::ptrdiff_t>(
+          core_thread_count(config.core_threads_, config.core_cpus_) + 1)) {
+    auto core_threads =
+        core_thread_count(config.core_threads_, config.core_cpus_);
     if (core_threads == 0) {
         throw std::invalid_argument(
             "executor must support at least one core thread");
     }
-    if (blocking_threads == 0) {
+    if (config.max_blocking_threads_ == 0) {
         throw std::invalid_argument(
             "executor must support at least one blocking thread");
     }
-    core_workers_.reserve(core_threads);
-    for (std::size_t i = 0; i < core_threads; ++i) {
-        core_workers_.emplace_back([this] { core_work(); });
+    auto cpu_count = *available_cpu_cores();
+    for (const auto* cpus : {&config.core_cpus_, &config.blocking_cpus_}) {
+        for (auto cpu : *cpus) {
+            if (cpu >= cpu_count) {
+                throw std::invalid_argument("CPU index out of range");
+            }
+        }
     }
-    blocking_workers_.reserve(blocking_threads);
-    for (std::size_t i = 0; i < blocking_threads; ++i) {
-        blocking_workers_.emplace_back([this] { blocking_work(); });
+
+    blocking_ = std::make_unique<blocking_pool>(
+        config.max_blocking_threads_, config.blocking_keep_alive_,
+        thread_options{config.blocking_thread_name_, config.blocking_cpus_,
+                       config.blocking_stack_size_},
+        [this](const std::function<void()>& work) {
+            exec_guard ex{*this};
+            work();
+        });
+    workers_.resize(core_threads);
+    if (mode_ == executor_mode::work_stealing) {
+        // an extra slot for the thread calling block_on, so that other
+        // threads can steal from it like from any core thread
+        workers_.push_back(
+            std::make_unique<worker>(*this, core_threads, &context_));
+        caller_ = workers_.back().get();
     }
+
+    core_workers_.reserve(core_threads);
+    try {
+        for (std::size_t i = 0; i < core_threads; ++i) {
+            thread_options options{
+                config.core_thread_name_ + '-' + std::to_string(i), {},
+                config.core_stack_size_};
+            if (!config.core_cpus_.empty()) {
+                options.cpus.push_back(
+                    config.core_cpus_[i % config.core_cpus_.size()]);
+            }
+            core_workers_.emplace_back(options, [this, i] {
+                // built by the thread itself, which already runs on its
+                // CPUs, so that the run queues and I/O context are first
+                // touched, and so placed, on the thread's NUMA node
+                workers_[i] = std::make_unique<worker>(
+                    *this, i,
+                    mode_ == executor_mode::sharded ? nullptr : &context_);
+                workers_[i]->stop = &core_done_;
+                // other workers are only looked at once all of them exist
+                workers_built_.arrive_and_wait();
+                if (core_done_.load()) { return; }
+                exec_guard ex{*this};
+                timer_slack_guard slack{precise_timer_slack_};
+                core_work(*workers_[i]);
+            });
+        }
+    } catch (...) {
+        // let the threads that did start go without running
+        core_done_.store(true);
+        workers_built_.count_down(
+            static_cast<std::ptrdiff_t>(core_threads - core_workers_.size()));
+        workers_built_.arrive_and_wait();
+        for (auto& thread : core_workers_) { thread.join(); }
+        throw;
+    }
+    workers_built_.arrive_and_wait();
+}
+
+executor::builder& executor::builder::core_threads(std::size_t count) {
+    core_threads_ = count;
+    return *this;
+}
+
+executor::builder& executor::builder::max_blocking_threads(std::size_t count) {
+    max_blocking_threads_ = count;
+    return *this;
+}
+
+executor::builder& executor::builder::blocking_keep_alive(
+    std::chrono::nanoseconds keep_alive) {
+    blocking_keep_alive_ = keep_alive;
+    return *this;
+}
+
+executor::builder& executor::builder::mode(executor_mode mode) {
+    mode_ = mode;
+    return *this;
+}
+
+executor::builder& executor::builder::parking(park_policy parking) {
+    parking_ = parking;
+    return *this;
+}
+
+executor::builder& executor::builder::timer_slack(
+    std::chrono::microseconds slack) {
+    timer_slack_ = slack;
+    return *this;
+}
+
+executor::builder& executor::builder::precise_timer_slack(bool enable) {
+    precise_timer_slack_ = enable;
+    return *this;
 }
 
+executor::builder& executor::builder::core_cpus(std::vector<std::size_t> cpus) {
+    core_cpus_ = std::move(cpus);
+    return *this;
+}
+
+executor::builder& executor::builder::blocking_cpus(
+    std::vector<std::size_t> cpus) {
+    blocking_cpus_ = std::move(cpus);
+    return *this;
+}
+
+executor::builder& executor::builder::core_thread_name(std::string name) {
+    core_thread_name_ = std::move(name);
+    return *this;
+}
+
+executor::builder& executor::builder::blocking_thread_name(std::string name) {
+    blocking_thread_name_ = std::move(name);
+    return *this;
+}
+
+executor::builder& executor::builder::core_stack_size(std::size_t bytes) {
+    core_stack_size_ = bytes;
+    return *this;
+}
+
+executor::builder& executor::builder::blocking_stack_size(std::size_t bytes) {
+    blocking_stack_size_ = bytes;
+    return *this;
+}
+
+executor executor::builder::build() const { return executor{*this}; }
+
 executor::~executor() {
-    {
-        std::lock_guard<std::mutex> lock{blocking_mut_};
-        blocking_done_ = true;
-    }
-    blocking_cv_.notify_all();
-    for (auto& worker : blocking_workers_) { worker.join(); }
+    // blocking tasks may still wake async ones, so they finish first
+    blocking_.reset();
 
-    {
-        std::lock_guard<std::mutex> lock{core_mut_};
-        core_done_ = true;
+    core_done_.store(true);
+    core_guard_.reset();
+    context_.stop();
+    for (auto& w : workers_) {
+        if (w->own_context) {
+            w->guard.reset();
+            w->own_context->stop();
+        }
     }
-    core_cv_.notify_all();
-    for (auto& worker : core_workers_) { worker.join(); }
+    for (auto& thread : core_workers_) { thread.join(); }
 }
 
 void executor::block_on_impl(future<void> (*func)(void*), void* data) {
+    // the calling thread becomes a worker until the root task finishes,
+    // unless another thread already holds the slot, or there is none since
+    // shards only ever run on their own threads
+    if (caller_ == nullptr || local_worker() != nullptr) {
+        hand_off(func, data);
+        return;
+    }
+
+    // throws on nested executors, so before the slot is taken
+    exec_guard guard{*this};
+    if (caller_busy_.exchange(true, std::memory_order_acquire)) {
+        hand_off(func, data);
+        return;
+    }
+
+    // restored once the thread leaves, whether or not the root task throws
+    timer_slack_guard slack{precise_timer_slack_};
+    std::atomic<bool> done{false};
+    std::exception_ptr ex;
+    caller_->stop = &done;
+    // the root task has normal priority, whatever last ran on this thread
+    detail::begin_task(priority::normal);
+    // the root task is detached so that its frame is destroyed by the
+    // thread that finishes it, rather than racing with the caller
+    spawn_detached([](auto fn, auto ptr, auto& dn, auto& err,
+                      executor* exec) -> future<void> {
+        try {
+            co_await fn(ptr);
+        } catch (...) { err = std::current_exception(); }
+        dn.store(true, std::memory_order_release);
+        exec->wake_caller();
+    }(func, data, done, ex, this));
+    core_work(*caller_);
+
+    caller_->stop = nullptr;
+    // leave whatever the caller had queued to the core threads
+    for (std::size_t lane = 0; lane < detail::PRIORITY_LANES; ++lane) {
+        auto& yielded = caller_->lanes[lane].yielded;
+        for (auto task : yielded) { inject_.push(task, lane); }
+        yielded.clear();
+    }
+    if (caller_->has_tasks() || !inject_.empty()) { notify_idle(); }
+    caller_busy_.store(false, std::memory_order_release);
+    if (ex != nullptr) { std::rethrow_exception(ex); }
+}
+
+void executor::hand_off(future<void> (*func)(void*), void* data) {
     std::mutex mut;
     std::condition_variable cv;
     bool done = false;
-    std::coroutine_handle<future<void>::promise_type> handle;
-    auto work_guard = asio::make_work_guard(context_);
-    asio::post(context_, [this, func, data, &mut, &cv, &done, &handle] {
-        handle = [](auto fn, auto ptr, auto& mtx, auto& cond_var,
-                    auto& dn) -> future<void> {
-            co_await fn(ptr);
-            {
-                std::lock_guard<std::mutex> lock{mtx};
-                dn = true;
-            }
+    std::exception_ptr ex;
+    asio::post(current_context(), [func, data, &mut, &cv, &done, &ex] {
+        detail::begin_task(priority::normal);
+        spawn_detached([](auto fn, auto ptr, auto& mtx, auto& cond_var,
+                          auto& dn, auto& err) -> future<void> {
+            try {
+                co_await fn(ptr);
+            } catch (...) { err = std::current_exception(); }
+            std::lock_guard<std::mutex> lock{mtx};
+            dn = true;
             cond_var.notify_one();
-        }(func, data, mut, cv, done)
-                                     .into_handle();
+        }(func, data, mut, cv, done, ex));
     });
-    {
-        std::lock_guard<std::mutex> lock{core_mut_};
-        core_work_pending_ = true;
+    std::unique_lock<std::mutex> lock{mut};
+    cv.wait(lock, [&done] { return done; });
+    if (ex != nullptr) { std::rethrow_exception(ex); }
+}
+
+park_stats executor::parking_stats() const {
+    park_stats stats;
+    for (const auto& w : workers_) {
+        stats.idle += w->idle_count.load(std::memory_order_relaxed);
+        stats.spin_hits += w->spin_hits.load(std::memory_order_relaxed);
+        stats.parks += w->parks.load(std::memory_order_relaxed);
     }
-    core_cv_.notify_one();
-    {
-        std::unique_lock<std::mutex> lock{mut};
-        cv.wait(lock, [&done] { return done; });
+    stats.unparks = unparks_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::size_t executor::shard_count() const {
+    return mode_ == executor_mode::sharded ? workers_.size() : 1;
+}
+
+std::chrono::microseconds executor::timer_slack() const {
+    return timer_slack_.load(std::memory_order_relaxed);
+}
+
+void executor::set_timer_slack(std::chrono::microseconds slack) {
+    timer_slack_.store(std::max(std::chrono::microseconds{0}, slack),
+                       std::memory_order_relaxed);
+}
+
+std::size_t executor::current_shard() const {
+    auto self = local_worker();
+    if (self == nullptr) { return detail::NO_SHARD; }
+    return mode_ == executor_mode::sharded ? self->index : 0;
+}
+
+std::size_t executor::pick_shard() {
+    return next_shard_.fetch_add(1, std::memory_order_relaxed) %
+           workers_.size();
+}
+
+asio::io_context& executor::current_context() {
+    if (mode_ == executor_mode::work_stealing) { return context_; }
+    if (auto self = local_worker(); self != nullptr) { return *self->context; }
+    // I/O objects created away from the core threads are spread over the
+    // shards in turn
+    return *workers_[pick_shard()]->context;
+}
+
+detail::timer_wheel& executor::current_timers() {
+    if (auto self = local_worker(); self != nullptr) { return *self->timers; }
+    return *workers_[pick_shard()]->timers;
+}
+
+void executor::schedule_task(std::coroutine_handle<> task, std::size_t shard,
+                             priority prio) {
+    assert(task && !task.done());
+    auto lane = detail::lane_of(prio);
+    auto self = local_worker();
+    if (mode_ == executor_mode::work_stealing) {
+        if (self != nullptr) {
+            // woken on one of our core threads, so keep it local to that core
+            self->lanes[lane].tasks.push(task);
+        } else {
+            inject_.push(task, lane);
+        }
+        notify_idle();
+        return;
+    }
+
+    if (shard == detail::NO_SHARD) {
+        shard = self != nullptr ? self->index : pick_shard();
+    }
+    assert(shard < workers_.size());
+    if (self != nullptr && self->index == shard) {
+        // the shard's own thread is running, so it will get to the task
+        self->lanes[lane].tasks.push(task);
+    } else {
+        auto& target = *workers_[shard];
+        target.inbox.push(task, lane);
+        notify_shard(target);
     }
-    [[maybe_unused]] future<void> guard{handle};
 }
 
-void executor::schedule_task(std::coroutine_handle<> task) {
+void executor::yield_task(std::coroutine_handle<> task, priority prio) {
     assert(task && !task.done());
-#ifndef NDEBUG
-    asio::post(context_, [=] {
-        assert(task && !task.done());
-        task.resume();
+    if (auto self = local_worker(); self != nullptr) {
+        self->lanes[detail::lane_of(prio)].yielded.push_back(task);
+    } else {
+        schedule_task(task, detail::NO_SHARD, prio);
+    }
+}
+
+void executor::task_inbox::push(std::coroutine_handle<> task,
+                                std::size_t lane) {
+    std::lock_guard<std::mutex> lock{mut};
+    tasks[lane].push_back(task);
+    len[lane].fetch_add(1, std::memory_order_release);
+}
+
+std::coroutine_handle<> executor::task_inbox::take(std::size_t lane) {
+    if (len[lane].load(std::memory_order_acquire) == 0) { return {}; }
+    std::lock_guard<std::mutex> lock{mut};
+    if (tasks[lane].empty()) { return {}; }
+    auto task = tasks[lane].front();
+    tasks[lane].pop_front();
+    len[lane].fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+bool executor::task_inbox::empty() const {
+    return std::all_of(len.begin(), len.end(), [](const auto& lane_len) {
+        return lane_len.load(std::memory_order_acquire) == 0;
     });
-#else
-    asio::post(context_, task);
-#endif
 }
 
-void executor::run_blocking(void (*func)(void*), void* data) {
-    blocking_tasks_.push(blocking_task{func, data});
-    blocking_waiting_.fetch_add(1, std::memory_order_relaxed);
-    if (blocking_mut_.try_lock()) { blocking_mut_.unlock(); }
-    blocking_cv_.notify_one();
+bool executor::task_inbox::empty(std::size_t lane) const {
+    return len[lane].load(std::memory_order_acquire) == 0;
+}
+
+std::coroutine_handle<> executor::take_injected(worker& self,
+                                                std::size_t lane) {
+    return mode_ == executor_mode::sharded ? self.inbox.take(lane) :
+                                             inject_.take(lane);
+}
+
+void executor::notify_idle() {
+    // pairs with the fence in park(), so that either the parking thread sees
+    // the new task or this thread sees the parked one
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (caller_ != nullptr && caller_->idle.load(std::memory_order_relaxed)) {
+        signal_caller();
+    }
+    if (idle_workers_.load(std::memory_order_relaxed) == 0) { return; }
+    // one wake-up at a time; a woken thread that finds more work than it
+    // can handle wakes the next one
+    if (!wake_pending_.exchange(true, std::memory_order_acq_rel)) {
+        unparks_.fetch_add(1, std::memory_order_relaxed);
+        asio::post(context_, [this] {
+            wake_pending_.store(false, std::memory_order_release);
+        });
+    }
+}
+
+void executor::notify_shard(worker& target) {
+    // same handshake as notify_idle(), but with a single thread to wake
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!target.idle.load(std::memory_order_relaxed)) { return; }
+    if (!target.wake_pending.exchange(true, std::memory_order_acq_rel)) {
+        unparks_.fetch_add(1, std::memory_order_relaxed);
+        asio::post(*target.context, [&target] {
+            target.wake_pending.store(false, std::memory_order_release);
+        });
+    }
+}
+
+void executor::wake_caller() {
+    // pairs with the fence in park(), as in notify_idle()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (caller_->idle.load(std::memory_order_relaxed)) { signal_caller(); }
+}
+
+void executor::signal_caller() {
+    unparks_.fetch_add(1, std::memory_order_relaxed);
+    caller_->signal.fetch_add(1, std::memory_order_release);
+    caller_->signal.notify_one();
+}
+
+bool executor::has_pending_tasks(const worker& self) const {
+    if (mode_ == executor_mode::sharded) {
+        return !self.inbox.empty() || self.has_tasks();
+    }
+    if (!inject_.empty()) { return true; }
+    return std::any_of(workers_.begin(), workers_.end(),
+                       [](const auto& w) { return w->has_tasks(); });
+}
+
+bool executor::lane_has_tasks(const worker& self, std::size_t lane) const {
+    const auto& ln = self.lanes[lane];
+    if (!ln.tasks.empty() || !ln.yielded.empty()) { return true; }
+    return mode_ == executor_mode::sharded ? !self.inbox.empty(lane) :
+                                             !inject_.empty(lane);
+}
+
+std::coroutine_handle<> executor::steal_task(worker& self, std::size_t lane) {
+    auto count = workers_.size();
+    auto start = self.next_random() % count;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto& victim = *workers_[(start + i) % count];
+        // checked first, since stealing costs a fence even when there is
+        // nothing to take
+        if (&victim == &self || victim.lanes[lane].tasks.empty()) { continue; }
+        if (auto task = victim.lanes[lane].tasks.steal(); task.has_value()) {
+            return *task;
+        }
+    }
+    return {};
 }
 
-void executor::core_work() {
-    exec_guard ex{*this};
-    for (;;) {
-        {
-            std::unique_lock<std::mutex> lock{core_mut_};
-            core_cv_.wait(lock,
-                          [this] { return core_work_pending_ || core_done_; });
-            if (core_done_) { break; }
-            core_work_pending_ = false;
+std::coroutine_handle<> executor::take_task(worker& self, std::size_t lane) {
+    auto& ln = self.lanes[lane];
+    self.current_lane = lane;
+    // checked first, since popping an empty deque costs a fence
+    if (!ln.tasks.empty()) {
+        if (auto task = ln.tasks.pop(); task.has_value()) { return *task; }
+    }
+    if (auto task = take_injected(self, lane)) { return task; }
+    if (!ln.yielded.empty()) {
+        // anything the poll wakes goes ahead of the yielded tasks, in its
+        // own lane, which may be more urgent than this one
+        self.context->poll();
+        for (std::size_t woken = 0; woken <= lane; ++woken) {
+            auto& tasks = self.lanes[woken].tasks;
+            if (tasks.empty()) { continue; }
+            if (auto task = tasks.pop(); task.has_value()) {
+                self.current_lane = woken;
+                return *task;
+            }
+        }
+        auto task = ln.yielded.front();
+        ln.yielded.pop_front();
+        return task;
+    }
+    // the other workers' tasks of a lane go ahead of this worker's less
+    // urgent ones
+    if (mode_ == executor_mode::work_stealing) {
+        return steal_task(self, lane);
+    }
+    return {};
+}
+
+std::coroutine_handle<> executor::next_task(worker& self) {
+    if (++self.tick % CHECK_INTERVAL == 0) {
+        self.context->poll();
+        // injected tasks get a turn ahead of the worker's own, but not ahead
+        // of its more urgent ones
+        for (std::size_t lane = 0; lane < detail::PRIORITY_LANES; ++lane) {
+            if (auto task = take_injected(self, lane)) {
+                self.current_lane = lane;
+                return task;
+            }
+            const auto& ln = self.lanes[lane];
+            if (!ln.tasks.empty() || !ln.yielded.empty()) { break; }
+        }
+    }
+    // a lane that has waited long enough goes ahead of the more urgent ones
+    for (std::size_t lane = 1; lane < detail::PRIORITY_LANES; ++lane) {
+        if (self.passed[lane] >= PRIORITY_AGING_LIMIT) {
+            self.passed[lane] = 0;
+            if (auto task = take_task(self, lane)) { return task; }
         }
-        context_.run();
     }
+    for (std::size_t lane = 0; lane < detail::PRIORITY_LANES; ++lane) {
+        if (auto task = take_task(self, lane)) {
+            auto taken = self.current_lane;
+            self.passed[taken] = 0;
+            for (auto other = taken + 1; other < detail::PRIORITY_LANES;
+                 ++other) {
+                if (lane_has_tasks(self, other)) { ++self.passed[other]; }
+            }
+            return task;
+        }
+    }
+    return {};
 }
 
-void executor::blocking_work() {
-    exec_guard ex{*this};
-    for (;;) {
-        auto task = blocking_tasks_.pop();
-        if (task.has_value()) {
-            blocking_waiting_.fetch_sub(1, std::memory_order_relaxed);
-            task->func(task->data);
+// Polls for work as long as the park policy allows, returning whether any
+// turned up, or the worker was told to stop
+bool executor::spin(worker& self) {
+    if (parking_.spin.count() == 0 && parking_.yield.count() == 0) {
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto spin_end = deadline_after(now, parking_.spin);
+    auto yield_end = deadline_after(spin_end, parking_.yield);
+    for (std::uint32_t round = 1;; ++round) {
+        if (self.stop->load(std::memory_order_acquire) ||
+            has_pending_tasks(self)) {
+            return true;
+        }
+        if (round % SPIN_POLL_INTERVAL == 0 && self.context->poll() > 0) {
+            return true;
+        }
+        now = std::chrono::steady_clock::now();
+        if (now >= yield_end) { return false; }
+        if (now < spin_end) {
+            cpu_relax();
         } else {
-            std::unique_lock<std::mutex> lock{blocking_mut_};
-            blocking_cv_.wait(lock, [this] {
-                return blocking_done_ ||
-                       blocking_waiting_.load(std::memory_order_relaxed) > 0;
-            });
-            if (blocking_done_) { break; }
+            std::this_thread::yield();
         }
     }
 }
 
+void executor::park(worker& self) {
+    self.idle_count.fetch_add(1, std::memory_order_relaxed);
+    if (spin(self)) {
+        self.spin_hits.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (mode_ == executor_mode::sharded) {
+        self.idle.store(true, std::memory_order_relaxed);
+        // pairs with the fence in notify_shard()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!has_pending_tasks(self) && !core_done_.load()) {
+            self.parks.fetch_add(1, std::memory_order_relaxed);
+            self.context->run_one();
+        }
+        self.idle.store(false, std::memory_order_relaxed);
+        return;
+    }
+
+    if (&self == caller_) {
+        // the caller waits on its own signal rather than in the I/O
+        // context, since only it can notice that the root task finished
+        self.idle.store(true, std::memory_order_relaxed);
+        // pairs with the fences in notify_idle() and wake_caller()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto signal = self.signal.load(std::memory_order_acquire);
+        if (!has_pending_tasks(self) &&
+            !self.stop->load(std::memory_order_acquire)) {
+            self.parks.fetch_add(1, std::memory_order_relaxed);
+            self.signal.wait(signal, std::memory_order_acquire);
+        }
+        self.idle.store(false, std::memory_order_relaxed);
+        return;
+    }
+
+    idle_workers_.fetch_add(1, std::memory_order_relaxed);
+    // pairs with the fence in notify_idle()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!has_pending_tasks(self) && !core_done_.load()) {
+        // blocks until an I/O completion or a wake-up from notify_idle()
+        self.parks.fetch_add(1, std::memory_order_relaxed);
+        context_.run_one();
+    }
+    idle_workers_.fetch_sub(1, std::memory_order_relaxed);
+    if (self.has_tasks()) { notify_idle(); }
+}
+
+void executor::run_blocking(void (*func)(void*), void* const* data,
+                            std::size_t count) {
+    blocking_->run(func, data, count);
+}
+
+void executor::core_work(worker& self) {
+    current_worker() = &self;
+    while (!self.stop->load(std::memory_order_acquire)) {
+        auto task = next_task(self);
+        if (task) {
+            assert(!task.done());
+            detail::begin_task(static_cast<priority>(self.current_lane));
+            task.resume();
+        } else if (self.context->poll() == 0) {
+            park(self);
+        }
+    }
+    current_worker() = nullptr;
+}
+
 namespace detail {
 
-bool in_executor_context() { return g_exec != nullptr; }
+bool in_executor_context() {
+    return g_exec != nullptr || local_executor::current() != nullptr;
+}
 
 void schedule_task(std::coroutine_handle<> handle) {
-    if (g_exec == nullptr) {
+    schedule_task(handle, NO_SHARD, g_priority);
+}
+
+void schedule_task(std::coroutine_handle<> handle, std::size_t shard,
+                   priority prio) {
+    if (g_exec != nullptr) {
+        g_exec->schedule_task(std::move(handle), shard, prio);
+    } else if (auto local = local_executor::current(); local != nullptr) {
+        // a local executor has a single shard
+        local->schedule_task(std::move(handle), prio);
+    } else {
         throw std::runtime_error(
             "attempt to execute async task outside of executor context");
     }
-    g_exec->schedule_task(std::move(handle));
 }
 
-asio::io_context& context() {
-    if (g_exec == nullptr) {
+std::size_t current_shard() {
+    if (g_exec != nullptr) { return g_exec->current_shard(); }
+    auto local = local_executor::current();
+    return local != nullptr && local->on_thread() ? 0 : NO_SHARD;
+}
+
+bool tasks_stay_on_thread() {
+    if (g_exec != nullptr) {
+        // only a shard's own tasks never move between threads
+        return g_exec->mode_ == executor_mode::sharded &&
+               g_exec->local_worker() != nullptr;
+    }
+    auto local = local_executor::current();
+    return local != nullptr && local->on_thread();
+}
+
+void yield_task(std::coroutine_handle<> handle) {
+    if (g_exec != nullptr) {
+        g_exec->yield_task(handle, g_priority);
+    } else if (auto local = local_executor::current(); local != nullptr) {
+        local->yield_task(handle, g_priority);
+    } else {
         throw std::runtime_error(
-            "attempt to access async I/O context outside of executor context");
+            "attempt to execute async task outside of executor context");
     }
-    return g_exec->context_;
+}
+
+bool consume_budget() {
+    if (g_budget == 0) { return false; }
+    --g_budget;
+    return true;
+}
+
+priority current_priority() { return g_priority; }
+
+void begin_task(priority prio) {
+    g_budget = TASK_BUDGET;
+    g_priority = prio;
+}
+
+void defer_next_start() {
+    g_defer_start = true;
+    g_deferred = nullptr;
+}
+
+bool start_deferred() { return g_defer_start; }
+
+void hold_start(std::coroutine_handle<> handle) {
+    g_defer_start = false;
+    g_deferred = handle;
+}
+
+std::coroutine_handle<> take_deferred_start() {
+    g_defer_start = false;
+    return std::exchange(g_deferred, nullptr);
+}
+
+asio::io_context& context() {
+    if (g_exec != nullptr) { return g_exec->current_context(); }
+    if (auto local = local_executor::current(); local != nullptr) {
+        return local->context_;
+    }
+    throw std::runtime_error(
+        "attempt to access async I/O context outside of executor context");
+}
+
+bool add_timer(timer_node& node, std::coroutine_handle<> suspended) {
+    node.task = waker::current(suspended);
+    return add_timer(node);
+}
+
+bool add_timer(timer_node& node) {
+    if (g_exec != nullptr) { return g_exec->current_timers().add(node); }
+    if (auto local = local_executor::current(); local != nullptr) {
+        return local->timers_->add(node);
+    }
+    throw std::runtime_error(
+        "attempt to sleep outside of executor context");
 }
 
 void run_blocking(void (*func)(void*), void* user_data) {
-    if (g_exec == nullptr) {
+    run_blocking(func, &user_data, 1);
+}
+
+void run_blocking(void (*func)(void*), void* const* user_data,
+                  std::size_t count) {
+    if (g_exec != nullptr) {
+        g_exec->run_blocking(func, user_data, count);
+    } else if (auto local = local_executor::current(); local != nullptr) {
+        local->run_blocking(func, user_data, count);
+    } else {
         throw std::runtime_error(
             "attempt to spawn blocking task outside of executor context");
     }
-    g_exec->run_blocking(func, user_data);
 }
 
 } // namespace detail
 
+option<std::size_t> this_shard() {
+    auto shard = detail::current_shard();
+    if (shard == detail::NO_SHARD) { return std::nullopt; }
+    return shard;
+}
+
+std::size_t shard_count() {
+    if (g_exec != nullptr) { return g_exec->shard_count(); }
+    if (local_executor::current() != nullptr) { return 1; }
+    throw std::runtime_error(
+        "attempt to query shards outside of executor context");
+}
+
+detail::schedule_awaiter move_to_shard(std::size_t shard) {
+    if (shard >= shard_count()) {
+        throw std::out_of_range("shard index out of range");
+    }
+    return detail::schedule_awaiter{shard, g_priority};
+}
+
 } // namespace crasy
@@ -0,0 +1,247 @@
+#include <crasy/frame_pool.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace crasy {
+
+namespace {
+
+// Number of frames a thread collects for another thread's pool before
+// handing them over in one go
+inline constexpr std::size_t REMOTE_BATCH = 32;
+
+// Most frames a pool keeps cached per size class; the rest go back to the heap
+inline constexpr std::size_t CLASS_CACHE_LIMIT = 256;
+
+inline constexpr std::uint32_t NO_CLASS = ~std::uint32_t{0};
+
+struct frame_pool;
+
+// Placed in front of every frame, and sized to keep the frame at the default
+// new alignment
+struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) frame_header {
+    frame_pool* owner;
+    std::uint32_t size_class;
+};
+
+// Overlays the frame of a cached allocation
+struct free_frame {
+    free_frame* next;
+};
+
+frame_header* header_of(void* frame) {
+    return static_cast<frame_header*>(frame) - 1;
+}
+
+// Counters are only written by the thread owning the pool, but may be read by
+// any thread collecting statistics
+void bump(std::atomic<std::size_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+}
+
+// Per-thread cache of frames. A pool outlives the thread it was made for, and
+// is adopted by the next thread that needs one, since frames it handed out
+// may still be freed long after that thread is gone.
+struct frame_pool {
+    struct frame_list {
+        free_frame* head{nullptr};
+        std::size_t length{0};
+    };
+
+    std::array<frame_list, FRAME_CLASS_COUNT> free;
+    // frames freed by other threads, in batches
+    std::atomic<free_frame*> remote{nullptr};
+
+    std::atomic<std::size_t> allocations{0};
+    std::atomic<std::size_t> pool_hits{0};
+    std::atomic<std::size_t> oversized{0};
+    std::atomic<std::size_t> remote_frees{0};
+    std::array<std::atomic<std::size_t>, FRAME_CLASS_COUNT> class_allocations{};
+
+    void cache(free_frame* frame) {
+        auto header = header_of(frame);
+        auto& list = free[header->size_class];
+        if (list.length < CLASS_CACHE_LIMIT) {
+            frame->next = list.head;
+            list.head = frame;
+            ++list.length;
+        } else {
+            ::operator delete(header);
+        }
+    }
+
+    void reclaim_remote() {
+        if (remote.load(std::memory_order_relaxed) == nullptr) { return; }
+        auto frame = remote.exchange(nullptr, std::memory_order_acquire);
+        while (frame != nullptr) {
+            auto next = frame->next;
+            cache(frame);
+            frame = next;
+        }
+    }
+};
+
+struct pool_registry {
+    std::mutex mut;
+    std::vector<std::unique_ptr<frame_pool>> pools;
+    std::vector<frame_pool*> unused;
+};
+
+pool_registry& registry() {
+    // never destroyed, since frames may be freed during static destruction
+    static auto reg = new pool_registry;
+    return *reg;
+}
+
+struct thread_state {
+    frame_pool* pool{nullptr};
+    // frames freed on this thread that belong to another thread's pool
+    frame_pool* batch_owner{nullptr};
+    free_frame* batch_head{nullptr};
+    free_frame* batch_tail{nullptr};
+    std::size_t batch_length{0};
+    bool exiting{false};
+
+    void flush_batch() {
+        if (batch_head == nullptr) { return; }
+        auto& remote = batch_owner->remote;
+        auto head = remote.load(std::memory_order_relaxed);
+        do {
+            batch_tail->next = head;
+        } while (!remote.compare_exchange_weak(head, batch_head,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+        batch_owner = nullptr;
+        batch_head = nullptr;
+        batch_tail = nullptr;
+        batch_length = 0;
+    }
+};
+
+thread_local thread_state t_state;
+
+// Hands the thread's pool back to the registry when the thread exits
+struct pool_release {
+    pool_release() = default;
+    pool_release(const pool_release&) = delete;
+    pool_release(pool_release&&) = delete;
+    pool_release& operator=(const pool_release&) = delete;
+    pool_release& operator=(pool_release&&) = delete;
+
+    ~pool_release() {
+        t_state.flush_batch();
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lock{reg.mut};
+        reg.unused.push_back(t_state.pool);
+        t_state.pool = nullptr;
+        t_state.exiting = true;
+    }
+};
+
+frame_pool* local_pool() {
+    if (t_state.pool != nullptr || t_state.exiting) { return t_state.pool; }
+    static thread_local pool_release release;
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock{reg.mut};
+    if (reg.unused.empty()) {
+        reg.pools.push_back(std::make_unique<frame_pool>());
+        t_state.pool = reg.pools.back().get();
+    } else {
+        t_state.pool = reg.unused.back();
+        reg.unused.pop_back();
+    }
+    return t_state.pool;
+}
+
+} // namespace
+
+frame_pool_stats frame_pool_statistics() {
+    frame_pool_stats stats;
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock{reg.mut};
+    for (const auto& pool : reg.pools) {
+        stats.allocations += pool->allocations.load(std::memory_order_relaxed);
+        stats.pool_hits += pool->pool_hits.load(std::memory_order_relaxed);
+        stats.oversized += pool->oversized.load(std::memory_order_relaxed);
+        stats.remote_frees +=
+            pool->remote_frees.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < FRAME_CLASS_COUNT; ++i) {
+            stats.class_allocations[i] +=
+                pool->class_allocations[i].load(std::memory_order_relaxed);
+        }
+    }
+    return stats;
+}
+
+namespace detail {
+
+void* allocate_frame(std::size_t size) {
+    auto total = size + sizeof(frame_header);
+    auto size_class = (total - 1) / FRAME_CLASS_SIZE;
+    auto pool = local_pool();
+    if (pool != nullptr) {
+        bump(pool->allocations);
+        if (size_class >= FRAME_CLASS_COUNT) { bump(pool->oversized); }
+    }
+    if (pool == nullptr || size_class >= FRAME_CLASS_COUNT) {
+        auto header = static_cast<frame_header*>(::operator new(total));
+        header->owner = nullptr;
+        header->size_class = NO_CLASS;
+        return header + 1;
+    }
+
+    bump(pool->class_allocations[size_class]);
+    auto& list = pool->free[size_class];
+    if (list.head == nullptr) { pool->reclaim_remote(); }
+    if (list.head != nullptr) {
+        // the header is still intact from the frame's last use
+        auto frame = list.head;
+        list.head = frame->next;
+        --list.length;
+        bump(pool->pool_hits);
+        return frame;
+    }
+    auto header = static_cast<frame_header*>(
+        ::operator new((size_class + 1) * FRAME_CLASS_SIZE));
+    header->owner = pool;
+    header->size_class = static_cast<std::uint32_t>(size_class);
+    return header + 1;
+}
+
+void deallocate_frame(void* frame) noexcept {
+    auto header = header_of(frame);
+    if (header->owner == nullptr) {
+        ::operator delete(header);
+        return;
+    }
+    auto node = static_cast<free_frame*>(frame);
+    if (header->owner == t_state.pool) {
+        t_state.pool->cache(node);
+        return;
+    }
+
+    // a thread that only ever frees frames still needs a pool, so that its
+    // batch is handed over when it exits
+    auto pool = local_pool();
+    if (pool != nullptr) { bump(pool->remote_frees); }
+    if (t_state.batch_owner != header->owner) {
+        t_state.flush_batch();
+        t_state.batch_owner = header->owner;
+        t_state.batch_tail = node;
+    }
+    node->next = t_state.batch_head;
+    t_state.batch_head = node;
+    if (++t_state.batch_length >= REMOTE_BATCH || t_state.exiting) {
+        t_state.flush_batch();
+    }
+}
+
+} // namespace detail
+
+} // namespace crasy
@@ -0,0 +1,51 @@
+#include <crasy/interval.hpp>
+
+#include <stdexcept>
+
+namespace crasy {
+
+using steady = std::chrono::steady_clock;
+
+static stream<steady::time_point> run_interval(steady::time_point start,
+                                               steady::duration period,
+                                               missed_tick missed) {
+    detail::reusable_timer timer;
+    auto deadline = start;
+    while (true) {
+        co_await timer.wait_until(deadline);
+        if (timer.cancelled()) { co_return; }
+        // the consumer is back for the tick, so this is when it is taken
+        auto now = steady::now();
+        auto tick = deadline;
+        deadline += period;
+        if (deadline <= now) {
+            switch (missed) {
+            case missed_tick::burst:
+                break;
+            case missed_tick::delay:
+                deadline = now + period;
+                break;
+            case missed_tick::skip:
+                deadline += period * ((now - deadline) / period + 1);
+                break;
+            }
+        }
+        co_yield steady::time_point{tick};
+    }
+}
+
+stream<steady::time_point> interval(steady::duration period,
+                                    missed_tick missed) {
+    return interval_at(steady::now(), period, missed);
+}
+
+stream<steady::time_point> interval_at(steady::time_point start,
+                                       steady::duration period,
+                                       missed_tick missed) {
+    if (period <= steady::duration::zero()) {
+        throw std::invalid_argument("interval period must be positive");
+    }
+    return run_interval(start, period, missed);
+}
+
+} // namespace crasy
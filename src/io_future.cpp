@@ -5,20 +5,40 @@ namespace crasy::detail {
 
 #define FUTURE_DONE (reinterpret_cast<void*>(1))
 
-bool io_future::await_ready() const { return suspended_.load() != nullptr; }
+bool io_future::await_ready() const {
+    // a task flooded with completed I/O yields once its budget is spent
+    return suspended_.load() != nullptr && detail::consume_budget();
+}
 
-void io_future::await_suspend(std::coroutine_handle<> suspended) {
+void io_future::suspend(std::coroutine_handle<> suspended, cancel_slot* slot) {
     auto handle = suspended.address();
+    // published along with the handle by the exchange
+    priority_ = detail::current_priority();
+    if (slot != nullptr) {
+        slot_ = slot;
+        // the operation has already started, so a coroutine cancelled
+        // beforehand cancels it right away
+        if (!slot->attach(target_)) { target_.cancel(target_.data); }
+    }
     if (suspended_.exchange(handle) == FUTURE_DONE) {
-        detail::schedule_task(suspended);
+        if (slot_ != nullptr) { slot_->detach(target_); }
+        detail::yield_task(suspended);
     }
 }
 
 void io_future::finish() {
     auto handle = suspended_.exchange(FUTURE_DONE);
     if (handle != nullptr) {
-        detail::schedule_task(std::coroutine_handle<>::from_address(handle));
+        // before the task can resume and destroy this
+        if (slot_ != nullptr) { slot_->detach(target_); }
+        detail::schedule_task(std::coroutine_handle<>::from_address(handle),
+                              NO_SHARD, priority_);
     }
 }
 
+void io_future::emit(void* self) {
+    static_cast<io_future*>(self)->signal_.emit(
+        asio::cancellation_type::terminal);
+}
+
 } // namespace crasy::detail
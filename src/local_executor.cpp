@@ -0,0 +1,198 @@
+#include <crasy/local_executor.hpp>
+#include <crasy/spawn.hpp>
+#include "blocking_pool.hpp"
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wuseless-cast"
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+#pragma GCC diagnostic ignored "-Wconversion"
+#endif
+#include <asio.hpp>
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+namespace crasy {
+
+namespace {
+
+// Number of tasks run between checks of the I/O context, so that a busy
+// ready queue does not starve I/O completions
+inline constexpr std::uint32_t LOCAL_CHECK_INTERVAL = 61;
+
+struct local_state {
+    local_executor* exec{nullptr};
+    // whether this thread is the one running block_on, rather than a
+    // blocking thread
+    bool runner{false};
+};
+
+thread_local local_state t_local;
+
+class local_guard {
+  public:
+    local_guard(local_executor& exec, bool runner) {
+        if (t_local.exec != nullptr || detail::in_executor_context()) {
+            throw std::runtime_error("attempt to nest executors");
+        }
+        t_local = local_state{&exec, runner};
+    }
+
+    ~local_guard() { t_local = local_state{}; }
+
+    local_guard(const local_guard&) = delete;
+    local_guard(local_guard&&) = delete;
+    local_guard& operator=(const local_guard&) = delete;
+    local_guard& operator=(local_guard&&) = delete;
+};
+
+} // namespace
+
+local_executor::local_executor()
+    : local_executor(executor::DEFAULT_MAX_BLOCKING_THREADS) {}
+
+local_executor::local_executor(std::size_t max_blocking_threads) {
+    if (max_blocking_threads == 0) {
+        throw std::invalid_argument(
+            "executor must support at least one blocking thread");
+    }
+    timers_ = std::make_unique<detail::timer_wheel>(context_, timer_slack_);
+    blocking_ = std::make_unique<blocking_pool>(
+        max_blocking_threads, executor::DEFAULT_BLOCKING_KEEP_ALIVE,
+        thread_options{"crasy-blocking", {}, 0},
+        [this](const std::function<void()>& work) {
+            local_guard guard{*this, false};
+            work();
+        });
+}
+
+local_executor::~local_executor() {
+    // blocking tasks may still post wake-ups, so they finish first
+    blocking_.reset();
+}
+
+local_executor* local_executor::current() { return t_local.exec; }
+
+std::chrono::microseconds local_executor::timer_slack() const {
+    return timer_slack_.load(std::memory_order_relaxed);
+}
+
+void local_executor::set_timer_slack(std::chrono::microseconds slack) {
+    timer_slack_.store(std::max(std::chrono::microseconds{0}, slack),
+                       std::memory_order_relaxed);
+}
+
+bool local_executor::on_thread() const {
+    return t_local.exec == this && t_local.runner;
+}
+
+void local_executor::schedule_task(std::coroutine_handle<> task,
+                                   priority prio) {
+    assert(task && !task.done());
+    auto lane = detail::lane_of(prio);
+    if (on_thread()) {
+        ready_[lane].push_back(task);
+    } else {
+        // woken by a blocking thread; the post also wakes up block_on if it
+        // is waiting for I/O
+        asio::post(context_,
+                   [this, task, lane] { ready_[lane].push_back(task); });
+    }
+}
+
+void local_executor::yield_task(std::coroutine_handle<> task, priority prio) {
+    if (on_thread()) {
+        yielded_[detail::lane_of(prio)].push_back(task);
+    } else {
+        schedule_task(task, prio);
+    }
+}
+
+bool local_executor::lane_has_tasks(std::size_t lane) const {
+    return !ready_[lane].empty() || !yielded_[lane].empty();
+}
+
+std::coroutine_handle<> local_executor::take_task(std::size_t lane) {
+    auto& ready = ready_[lane];
+    if (ready.empty()) {
+        auto& yielded = yielded_[lane];
+        if (yielded.empty()) { return {}; }
+        // anything the poll wakes goes ahead of the yielded tasks
+        context_.poll();
+        ready.insert(ready.end(), yielded.begin(), yielded.end());
+        yielded.clear();
+    }
+    auto task = ready.front();
+    ready.pop_front();
+    detail::begin_task(static_cast<priority>(lane));
+    return task;
+}
+
+std::coroutine_handle<> local_executor::next_task() {
+    // a lane that has waited long enough goes ahead of the more urgent ones
+    for (std::size_t lane = 1; lane < detail::PRIORITY_LANES; ++lane) {
+        if (passed_[lane] >= PRIORITY_AGING_LIMIT) {
+            passed_[lane] = 0;
+            if (auto task = take_task(lane)) { return task; }
+        }
+    }
+    for (std::size_t lane = 0; lane < detail::PRIORITY_LANES; ++lane) {
+        if (auto task = take_task(lane)) {
+            passed_[lane] = 0;
+            for (auto other = lane + 1; other < detail::PRIORITY_LANES;
+                 ++other) {
+                if (lane_has_tasks(other)) { ++passed_[other]; }
+            }
+            return task;
+        }
+    }
+    return {};
+}
+
+void local_executor::run_blocking(void (*func)(void*), void* const* data,
+                                  std::size_t count) {
+    blocking_->run(func, data, count);
+}
+
+void local_executor::block_on_impl(future<void> (*func)(void*), void* data) {
+    local_guard guard{*this, true};
+    // the context stops when it runs out of work, as at the end of the last
+    // call to block_on
+    context_.restart();
+    // keeps run_one() waiting while the only pending work is on blocking
+    // threads
+    auto work = asio::make_work_guard(context_);
+    bool done = false;
+    std::exception_ptr ex;
+    // the root task has normal priority, whatever last ran on this thread
+    detail::begin_task(priority::normal);
+    spawn_detached([](auto fn, auto ptr, auto& dn, auto& err) -> future<void> {
+        try {
+            co_await fn(ptr);
+        } catch (...) { err = std::current_exception(); }
+        dn = true;
+    }(func, data, done, ex));
+
+    std::uint32_t tick = 0;
+    while (!done) {
+        if (auto task = next_task()) {
+            task.resume();
+            if (++tick % LOCAL_CHECK_INTERVAL == 0) { context_.poll(); }
+        } else if (context_.poll() == 0) {
+            context_.run_one();
+        }
+    }
+    if (ex != nullptr) { std::rethrow_exception(ex); }
+}
+
+} // namespace crasy
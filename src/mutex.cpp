@@ -1,24 +1,77 @@
 #include <crasy/mutex.hpp>
 
+#include <algorithm>
+
 namespace crasy {
 
-bool mutex_lock_future::await_ready() { return mtx_->try_lock(); }
+mutex_lock_future::mutex_lock_future(mutex& mtx) : mtx_(&mtx) {}
+
+bool mutex_lock_future::await_ready() {
+    if (!detail::consume_budget()) {
+        yield_ = true;
+        return false;
+    }
+    return mtx_->try_lock();
+}
 
 void mutex_lock_future::await_suspend(std::coroutine_handle<> suspended) {
-    mtx_->suspended_.push(suspended);
-    if (!mtx_->locked_.load(std::memory_order_relaxed)) {
-        detail::schedule_task(*mtx_->suspended_.pop());
+    static_cast<void>(suspend_unless_abandoned(suspended));
+}
+
+void mutex_lock_future::await_resume() {}
+
+bool mutex_lock_future::suspend_unless_abandoned(
+    std::coroutine_handle<> suspended) {
+    if (yield_ && mtx_->try_lock()) {
+        // take the lock, but let other tasks run before using it
+        detail::yield_task(suspended);
+        return true;
     }
+    std::unique_lock<std::mutex> lock{mtx_->mut_};
+    if (abandoned_) { return false; }
+    started_ = true;
+    if (mtx_->try_lock()) {
+        // unlocked while this task was suspending
+        lock.unlock();
+        detail::yield_task(suspended);
+        return true;
+    }
+    mtx_->suspended_.push_back(detail::waker::current(suspended));
+    return true;
+}
+
+bool mutex_lock_future::abandon_wait(std::coroutine_handle<> suspended) {
+    std::lock_guard<std::mutex> lock{mtx_->mut_};
+    auto& waiters = mtx_->suspended_;
+    auto it = std::find_if(waiters.begin(), waiters.end(),
+                           [&](const detail::waker& waiter) {
+                               return waiter.handle == suspended;
+                           });
+    if (it == waiters.end()) {
+        if (!started_) { abandoned_ = true; }
+        return false;
+    }
+    waiters.erase(it);
+    return true;
 }
 
-void await_resume() {}
+bool mutex::try_lock() {
+    return !locked_.exchange(true, std::memory_order_acquire);
+}
 
-bool mutex::try_lock() { return !locked_.exchange(true); }
+mutex_lock_future mutex::lock() { return mutex_lock_future{*this}; }
 
 void mutex::unlock() {
-    locked_.store(false);
-    auto suspended = suspended_.pop();
-    if (suspended.has_value()) { detail::schedule_task(*suspended); }
+    std::unique_lock<std::mutex> lock{mut_};
+    if (suspended_.empty()) {
+        locked_.store(false, std::memory_order_release);
+        return;
+    }
+    // the first waiter now owns the lock
+    auto next = suspended_.front();
+    suspended_.pop_front();
+    lock.unlock();
+    next.wake();
 }
 
 } // namespace crasy
@@ -14,11 +14,22 @@
 
 namespace crasy {
 
-struct resolve_one_any_future : public detail::io_future {
+// Resolution runs on asio's resolver thread, which does not take
+// cancellation slots, so it is cancelled through the resolver instead
+struct resolver_future : public detail::io_future {
     asio::ip::tcp::resolver resolver;
-    option<result<ip_address>> ret;
 
-    resolve_one_any_future() : resolver(detail::context()) {}
+    resolver_future() : resolver(detail::context()) {
+        set_canceller(
+            [](void* self) {
+                static_cast<resolver_future*>(self)->resolver.cancel();
+            },
+            this);
+    }
+};
+
+struct resolve_one_any_future : public resolver_future {
+    option<result<ip_address>> ret;
 
     void start(std::string_view host) {
         resolver.async_resolve(
@@ -47,12 +58,9 @@ future<result<ip_address>> resolve_one(std::string_view host) {
     co_return co_await fut;
 }
 
-struct resolve_one_v4_future : public detail::io_future {
-    asio::ip::tcp::resolver resolver;
+struct resolve_one_v4_future : public resolver_future {
     option<result<ipv4_address>> ret;
 
-    resolve_one_v4_future() : resolver(detail::context()) {}
-
     void start(std::string_view host) {
         resolver.async_resolve(
             asio::ip::tcp::v4(), host, "", asio::ip::tcp::resolver::passive,
@@ -78,12 +86,9 @@ future<result<ipv4_address>> resolve_one_v4(std::string_view host) {
     co_return co_await fut;
 }
 
-struct resolve_one_v6_future : public detail::io_future {
-    asio::ip::tcp::resolver resolver;
+struct resolve_one_v6_future : public resolver_future {
     option<result<ipv6_address>> ret;
 
-    resolve_one_v6_future() : resolver(detail::context()) {}
-
     void start(std::string_view host) {
         resolver.async_resolve(
             asio::ip::tcp::v6(), host, "", asio::ip::tcp::resolver::passive,
@@ -109,12 +114,9 @@ future<result<ipv6_address>> resolve_one_v6(std::string_view host) {
     co_return co_await fut;
 }
 
-struct resolve_any_future : public detail::io_future {
-    asio::ip::tcp::resolver resolver;
+struct resolve_any_future : public resolver_future {
     option<result<std::vector<ip_address>>> ret;
 
-    resolve_any_future() : resolver(detail::context()) {}
-
     void start(std::string_view host) {
         resolver.async_resolve(
             host, "", asio::ip::tcp::resolver::passive,
@@ -142,12 +144,9 @@ future<result<std::vector<ip_address>>> resolve(std::string_view host) {
     co_return co_await fut;
 }
 
-struct resolve_v4_future : public detail::io_future {
-    asio::ip::tcp::resolver resolver;
+struct resolve_v4_future : public resolver_future {
     option<result<std::vector<ipv4_address>>> ret;
 
-    resolve_v4_future() : resolver(detail::context()) {}
-
     void start(std::string_view host) {
         resolver.async_resolve(
             asio::ip::tcp::v4(), host, "", asio::ip::tcp::resolver::passive,
@@ -175,12 +174,9 @@ future<result<std::vector<ipv4_address>>> resolve_v4(std::string_view host) {
     co_return co_await fut;
 }
 
-struct resolve_v6_future : public detail::io_future {
-    asio::ip::tcp::resolver resolver;
+struct resolve_v6_future : public resolver_future {
     option<result<std::vector<ipv6_address>>> ret;
 
-    resolve_v6_future() : resolver(detail::context()) {}
-
     void start(std::string_view host) {
         resolver.async_resolve(
             asio::ip::tcp::v6(), host, "", asio::ip::tcp::resolver::passive,
@@ -21,12 +21,12 @@ bool shared_mutex_lock_future::await_ready() {
 
 void shared_mutex_lock_future::await_suspend(
     std::coroutine_handle<> suspended) {
-    mtx_->suspended_.push(suspended);
+    mtx_->suspended_.push(detail::waker::current(suspended));
     if (mtx_->state_.load(std::memory_order_relaxed) == 0) {
         for (;;) {
             auto sus = mtx_->suspended_.pop();
             if (sus.has_value()) {
-                detail::schedule_task(*sus);
+                sus->wake();
             } else {
                 break;
             }
@@ -40,12 +40,12 @@ bool shared_mutex_lock_shared_future::await_ready() { return mtx_->try_lock(); }
 
 void shared_mutex_lock_shared_future::await_suspend(
     std::coroutine_handle<> suspended) {
-    mtx_->suspended_.push(suspended);
+    mtx_->suspended_.push(detail::waker::current(suspended));
     if ((mtx_->state_.load(std::memory_order_relaxed) & EX_BIT) == 0) {
         for (;;) {
             auto sus = mtx_->suspended_.pop();
             if (sus.has_value()) {
-                detail::schedule_task(*sus);
+                sus->wake();
             } else {
                 break;
             }
@@ -65,7 +65,7 @@ void shared_mutex::unlock() {
     for (;;) {
         auto suspended = suspended_.pop();
         if (suspended.has_value()) {
-            detail::schedule_task(*suspended);
+            suspended->wake();
         } else {
             break;
         }
@@ -87,7 +87,7 @@ void shared_mutex::unlock_shared() {
         for (;;) {
             auto suspended = suspended_.pop();
             if (suspended.has_value()) {
-                detail::schedule_task(*suspended);
+                suspended->wake();
             } else {
                 break;
             }
@@ -0,0 +1,56 @@
+#include <crasy/sleep.hpp>
+#include "cpu_relax.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace crasy::detail {
+
+// Bounds on how long a precise sleep spins before its deadline
+inline constexpr std::chrono::microseconds MIN_PRECISE_SPIN{2};
+inline constexpr std::chrono::microseconds MAX_PRECISE_SPIN{200};
+
+// Weight of each new wake-up in the running averages, as a power of two
+inline constexpr int PRECISE_CALIBRATION_SHIFT = 3;
+
+namespace {
+
+// Running averages of how late the thread woke up for precise sleeps, and
+// how far from that average it was, in nanoseconds
+struct precise_calibration {
+    double late_ns{20000.0};
+    double dev_ns{10000.0};
+};
+
+thread_local precise_calibration t_precise;
+
+} // namespace
+
+std::chrono::steady_clock::duration precise_spin_margin() {
+    auto& cal = t_precise;
+    // enough to cover nearly all wake-ups, assuming they are about normal
+    auto margin = std::chrono::nanoseconds(
+        static_cast<std::int64_t>(cal.late_ns + 4.0 * cal.dev_ns));
+    return std::clamp<std::chrono::steady_clock::duration>(
+        margin, MIN_PRECISE_SPIN, MAX_PRECISE_SPIN);
+}
+
+void finish_precise_sleep(std::chrono::steady_clock::time_point deadline,
+                          std::chrono::steady_clock::time_point target,
+                          bool woken) {
+    auto now = std::chrono::steady_clock::now();
+    if (woken) {
+        auto& cal = t_precise;
+        auto late = std::chrono::duration<double, std::nano>(now - target)
+                        .count();
+        constexpr double weight = 1.0 / (1 << PRECISE_CALIBRATION_SHIFT);
+        cal.dev_ns += (std::abs(late - cal.late_ns) - cal.dev_ns) * weight;
+        cal.late_ns += (late - cal.late_ns) * weight;
+    }
+    while (now < deadline) {
+        cpu_relax();
+        now = std::chrono::steady_clock::now();
+    }
+}
+
+} // namespace crasy::detail
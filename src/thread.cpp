@@ -0,0 +1,164 @@
+#include "thread.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <exception>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+namespace crasy {
+
+#ifdef _WIN32
+
+os_thread::os_thread(const thread_options& options, std::function<void()> func)
+    : thread_([name = options.name, cpus = options.cpus,
+               fn = std::move(func)] {
+          if (!cpus.empty()) {
+              DWORD_PTR mask = 0;
+              for (auto cpu : cpus) {
+                  if (cpu < sizeof(mask) * CHAR_BIT) {
+                      mask |= DWORD_PTR{1} << cpu;
+                  }
+              }
+              SetThreadAffinityMask(GetCurrentThread(), mask);
+          }
+          if (!name.empty()) {
+              std::wstring wide(name.begin(), name.end());
+              SetThreadDescription(GetCurrentThread(), wide.c_str());
+          }
+          fn();
+      }) {}
+
+os_thread::os_thread(os_thread&& other) noexcept = default;
+
+os_thread::~os_thread() = default;
+
+os_thread& os_thread::operator=(os_thread&& rhs) noexcept = default;
+
+bool os_thread::joinable() const { return thread_.joinable(); }
+
+void os_thread::join() { thread_.join(); }
+
+#else
+
+namespace {
+
+struct start_info {
+    std::string name;
+    std::function<void()> func;
+};
+
+void check(int ret, const char* what) {
+    if (ret != 0) { throw std::system_error(ret, std::system_category(), what); }
+}
+
+void* run_thread(void* arg) {
+    std::unique_ptr<start_info> info{static_cast<start_info*>(arg)};
+    if (!info->name.empty()) {
+#if defined(__linux__)
+        // longer names are refused rather than truncated
+        auto name = info->name.substr(0, 15);
+        pthread_setname_np(pthread_self(), name.c_str());
+#elif defined(__APPLE__)
+        pthread_setname_np(info->name.c_str());
+#endif
+    }
+    info->func();
+    return nullptr;
+}
+
+} // namespace
+
+os_thread::os_thread(const thread_options& options, std::function<void()> func) {
+    pthread_attr_t attr;
+    check(pthread_attr_init(&attr), "failed to start thread");
+    auto destroy_attr = [](pthread_attr_t* ptr) { pthread_attr_destroy(ptr); };
+    std::unique_ptr<pthread_attr_t, decltype(destroy_attr)> attr_guard{
+        &attr, destroy_attr};
+
+    if (options.stack_size != 0) {
+        auto size = std::max(options.stack_size,
+                             static_cast<std::size_t>(PTHREAD_STACK_MIN));
+        check(pthread_attr_setstacksize(&attr, size),
+              "failed to set thread stack size");
+    }
+#ifdef __linux__
+    if (!options.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : options.cpus) {
+            if (cpu >= CPU_SETSIZE) {
+                check(EINVAL, "failed to set thread affinity");
+            }
+            CPU_SET(cpu, &set);
+        }
+        check(pthread_attr_setaffinity_np(&attr, sizeof(set), &set),
+              "failed to set thread affinity");
+    }
+#endif
+
+    auto info = std::make_unique<start_info>(
+        start_info{options.name, std::move(func)});
+    check(pthread_create(&handle_, &attr, &run_thread, info.get()),
+          "failed to start thread");
+    // now owned by the thread
+    info.release();
+    joinable_ = true;
+}
+
+os_thread::os_thread(os_thread&& other) noexcept
+    : handle_(other.handle_), joinable_(std::exchange(other.joinable_, false)) {
+}
+
+os_thread::~os_thread() {
+    // as with std::thread
+    if (joinable_) { std::terminate(); }
+}
+
+os_thread& os_thread::operator=(os_thread&& rhs) noexcept {
+    if (joinable_) { std::terminate(); }
+    handle_ = rhs.handle_;
+    joinable_ = std::exchange(rhs.joinable_, false);
+    return *this;
+}
+
+bool os_thread::joinable() const { return joinable_; }
+
+void os_thread::join() {
+    check(pthread_join(handle_, nullptr), "failed to join thread");
+    joinable_ = false;
+}
+
+#endif
+
+timer_slack_guard::timer_slack_guard(bool enable) {
+#ifdef __linux__
+    if (enable) {
+        auto saved = prctl(PR_GET_TIMERSLACK, 0UL, 0UL, 0UL, 0UL);
+        // one nanosecond is the least the kernel allows
+        if (saved > 0 && prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL) == 0) {
+            saved_ = static_cast<unsigned long>(saved);
+        }
+    }
+#else
+    static_cast<void>(enable);
+#endif
+}
+
+timer_slack_guard::~timer_slack_guard() {
+#ifdef __linux__
+    if (saved_ != 0) { prctl(PR_SET_TIMERSLACK, saved_, 0UL, 0UL, 0UL); }
+#endif
+}
+
+} // namespace crasy
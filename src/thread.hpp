@@ -0,0 +1,82 @@
+#ifndef CRASY_THREAD_HPP
+#define CRASY_THREAD_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <thread>
+#else
+#include <pthread.h>
+#endif
+
+namespace crasy {
+
+// How to set up a new thread
+struct thread_options {
+    // truncated to what the OS allows, which is 15 characters on Linux
+    std::string name;
+    // CPUs the thread may run on, or any if empty
+    std::vector<std::size_t> cpus;
+    // size of the thread's stack in bytes, or zero for the default
+    std::size_t stack_size{0};
+};
+
+// A joinable thread, like std::thread, but started with the given options.
+// Affinity is only supported on Linux and Windows, and the stack size only on
+// POSIX systems; elsewhere those options are ignored.
+class os_thread {
+  public:
+    os_thread() = default;
+    // Throws std::system_error if the thread cannot be started with the
+    // given options, such as when a CPU does not exist
+    os_thread(const thread_options& options, std::function<void()> func);
+
+    os_thread(const os_thread&) = delete;
+    os_thread(os_thread&& other) noexcept;
+
+    ~os_thread();
+
+    os_thread& operator=(const os_thread&) = delete;
+    os_thread& operator=(os_thread&& rhs) noexcept;
+
+    // False for a default-constructed or joined thread, as with std::thread
+    bool joinable() const;
+
+    void join();
+
+  private:
+#ifdef _WIN32
+    std::thread thread_;
+#else
+    pthread_t handle_{};
+    bool joinable_{false};
+#endif
+};
+
+// Cuts the kernel's timer slack of the calling thread to the least it
+// allows, if enabled, until destroyed, when the slack it had is restored.
+// Linux delays timers by up to 50 us by default, to batch wake-ups; other
+// systems have no such setting, so this does nothing there.
+class timer_slack_guard {
+  public:
+    explicit timer_slack_guard(bool enable);
+
+    timer_slack_guard(const timer_slack_guard&) = delete;
+    timer_slack_guard(timer_slack_guard&&) = delete;
+
+    ~timer_slack_guard();
+
+    timer_slack_guard& operator=(const timer_slack_guard&) = delete;
+    timer_slack_guard& operator=(timer_slack_guard&&) = delete;
+
+  private:
+    // the slack to restore, or zero to leave it be
+    unsigned long saved_{0};
+};
+
+} // namespace crasy
+
+#endif
@@ -0,0 +1,243 @@
+#include "timer_wheel.hpp"
+#include "cpu_relax.hpp"
+
+#include <bit>
+#include <cassert>
+#include <thread>
+
+namespace crasy::detail {
+
+// Spins before yielding while waiting out a timer's callback
+inline constexpr int FIRING_WAIT_SPINS = 64;
+
+timer_wheel::timer_wheel(
+    asio::io_context& context,
+    const std::atomic<std::chrono::microseconds>& default_slack)
+    : default_slack_(&default_slack), epoch_(clock::now()), context_(&context),
+      timer_(context) {}
+
+std::uint64_t timer_wheel::coarsen(std::uint64_t when, std::uint64_t slack) {
+    auto latest = when + slack;
+    auto differ = when ^ latest;
+    if (differ == 0) { return when; }
+    // `latest` with every bit below the highest one that differs from `when`
+    // cleared, which is the multiple of the largest power of two in the window
+    auto bit = std::uint64_t{1} << (63 - std::countl_zero(differ));
+    return latest & ~(bit - 1);
+}
+
+std::uint64_t timer_wheel::ticks_until(clock::time_point deadline) const {
+    if (deadline <= epoch_) { return 0; }
+    // rounded up, so that no timer fires early
+    return static_cast<std::uint64_t>(
+        std::chrono::ceil<std::chrono::microseconds>(deadline - epoch_)
+            .count());
+}
+
+timer_wheel::clock::time_point timer_wheel::time_of(std::uint64_t ticks) const {
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+        clock::time_point::max() - epoch_);
+    if (ticks >= static_cast<std::uint64_t>(left.count())) {
+        return clock::time_point::max();
+    }
+    return epoch_ + std::chrono::microseconds(ticks);
+}
+
+bool timer_wheel::add(timer_node& node) {
+    if (node.deadline <= clock::now()) { return false; }
+    auto slack = node.slack;
+    if (slack < std::chrono::microseconds{0}) {
+        slack = default_slack_->load(std::memory_order_relaxed);
+    }
+    node.when = coarsen(ticks_until(node.deadline),
+                        static_cast<std::uint64_t>(slack.count()));
+
+    std::lock_guard<std::mutex> lock{mut_};
+    // the deadline is after now, which is at or after elapsed_
+    if (node.when <= elapsed_) { node.when = elapsed_ + 1; }
+    // sequentially consistent, along with expire_timer(), so that either the
+    // timer is found here to have been expired, or expire_timer() finds it
+    // in the wheel
+    node.wheel.store(this);
+    if (node.expired.load()) {
+        node.wheel.store(nullptr, std::memory_order_relaxed);
+        return false;
+    }
+    insert(node);
+    arm();
+    return true;
+}
+
+void timer_wheel::cancel(timer_node& node) {
+    std::lock_guard<std::mutex> lock{mut_};
+    // fired in the meantime
+    if (node.wheel.load(std::memory_order_relaxed) != this) { return; }
+    unlink(node);
+    node.wheel.store(nullptr, std::memory_order_release);
+    // a timer_ that is left armed for this deadline goes off for nothing
+}
+
+void timer_wheel::expire(timer_node& node) {
+    std::lock_guard<std::mutex> lock{mut_};
+    if (node.wheel.load(std::memory_order_relaxed) != this) { return; }
+    unlink(node);
+    // copied out, since the task may destroy the node as soon as it is woken
+    auto task = node.task;
+    node.wheel.store(nullptr, std::memory_order_release);
+    if (context_->get_executor().running_in_this_thread()) {
+        task.wake();
+    } else {
+        // stop was requested from a thread that does not run this wheel,
+        // which may not belong to the task's executor, or to any
+        asio::post(*context_, [task] { task.wake(); });
+    }
+}
+
+void timer_wheel::insert(timer_node& node) {
+    // deadlines beyond the wheel wait in its last slot to be placed again
+    auto when = std::min(node.when, elapsed_ | (WHEEL_RANGE - 1));
+    // the highest group of SLOT_BITS bits in which the deadline differs from
+    // the current time picks the level
+    auto differ = (elapsed_ ^ when) | SLOT_MASK;
+    auto lvl = static_cast<std::size_t>(63 - std::countl_zero(differ)) /
+               SLOT_BITS;
+    auto slot = (when >> (lvl * SLOT_BITS)) & SLOT_MASK;
+
+    auto& head = levels_[lvl].slots[slot];
+    node.level = static_cast<std::uint8_t>(lvl);
+    node.slot = static_cast<std::uint8_t>(slot);
+    node.prev = nullptr;
+    node.next = head;
+    if (head != nullptr) { head->prev = &node; }
+    head = &node;
+    levels_[lvl].occupied |= std::uint64_t{1} << slot;
+}
+
+void timer_wheel::unlink(timer_node& node) {
+    auto& lvl = levels_[node.level];
+    if (node.prev != nullptr) {
+        node.prev->next = node.next;
+    } else {
+        lvl.slots[node.slot] = node.next;
+        if (node.next == nullptr) {
+            lvl.occupied &= ~(std::uint64_t{1} << node.slot);
+        }
+    }
+    if (node.next != nullptr) { node.next->prev = node.prev; }
+    node.prev = nullptr;
+    node.next = nullptr;
+}
+
+bool timer_wheel::next_expiration(std::uint64_t& ticks, std::size_t& lvl,
+                                  std::size_t& slot) const {
+    // every timer on a level is due before any on the levels above it
+    for (lvl = 0; lvl < LEVELS; ++lvl) {
+        auto occupied = levels_[lvl].occupied;
+        if (occupied == 0) { continue; }
+        auto shift = lvl * SLOT_BITS;
+        auto current = (elapsed_ >> shift) & SLOT_MASK;
+        // slots behind the current one were all emptied on the way past
+        auto ahead = occupied >> current;
+        assert(ahead != 0);
+        slot = current + static_cast<std::size_t>(std::countr_zero(ahead));
+        auto level_range = std::uint64_t{1} << (shift + SLOT_BITS);
+        ticks = (elapsed_ & ~(level_range - 1)) + (slot << shift);
+        return true;
+    }
+    return false;
+}
+
+void timer_wheel::fire_due(clock::time_point now, timer_node*& fired) {
+    auto now_ticks = ticks_until(now);
+    // ticks_until() rounds up, but a tick must have passed in full
+    if (now_ticks > 0 && time_of(now_ticks) > now) { --now_ticks; }
+
+    std::uint64_t ticks = 0;
+    std::size_t lvl = 0;
+    std::size_t slot = 0;
+    while (next_expiration(ticks, lvl, slot) && ticks <= now_ticks) {
+        elapsed_ = ticks;
+        auto& expired = levels_[lvl];
+        auto* node = expired.slots[slot];
+        expired.slots[slot] = nullptr;
+        expired.occupied &= ~(std::uint64_t{1} << slot);
+        while (node != nullptr) {
+            auto* next = node->next;
+            node->prev = nullptr;
+            node->next = nullptr;
+            if (node->when <= elapsed_ && node->fire != nullptr) {
+                node->wheel.store(firing_wheel(), std::memory_order_relaxed);
+                node->next = fired;
+                fired = node;
+            } else if (node->when <= elapsed_) {
+                // copied out, since the task may destroy the node as soon as
+                // it is woken
+                auto task = node->task;
+                node->wheel.store(nullptr, std::memory_order_release);
+                task.wake();
+            } else {
+                insert(*node);
+            }
+            node = next;
+        }
+    }
+    if (now_ticks > elapsed_) { elapsed_ = now_ticks; }
+}
+
+void timer_wheel::arm() {
+    std::uint64_t ticks = 0;
+    std::size_t lvl = 0;
+    std::size_t slot = 0;
+    if (!next_expiration(ticks, lvl, slot)) { return; }
+    auto deadline = time_of(ticks);
+    if (deadline >= armed_) { return; }
+    armed_ = deadline;
+    // cancels the wait for the later deadline, if any
+    timer_.expires_at(deadline);
+    timer_.async_wait([this](auto ec) {
+        if (ec != asio::error::operation_aborted) { on_timer(); }
+    });
+}
+
+void timer_wheel::on_timer() {
+    timer_node* fired = nullptr;
+    {
+        std::lock_guard<std::mutex> lock{mut_};
+        armed_ = clock::time_point::max();
+        fire_due(clock::now(), fired);
+        arm();
+    }
+    while (fired != nullptr) {
+        // read first, since the node may be destroyed once it is released
+        auto* next = fired->next;
+        fired->next = nullptr;
+        fired->fire(fired->data);
+        fired->wheel.store(nullptr, std::memory_order_release);
+        fired = next;
+    }
+}
+
+void cancel_timer_slow(timer_node& node) {
+    for (int spins = 0;; ++spins) {
+        auto wheel = node.wheel.load(std::memory_order_acquire);
+        if (wheel == nullptr) { return; }
+        if (wheel != firing_wheel()) {
+            // may find the timer firing by the time it has the lock
+            wheel->cancel(node);
+        } else if (spins < FIRING_WAIT_SPINS) {
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void expire_timer(timer_node& node) {
+    node.expired.store(true);
+    if (auto wheel = node.wheel.load();
+        wheel != nullptr && wheel != firing_wheel()) {
+        wheel->expire(node);
+    }
+}
+
+} // namespace crasy::detail
@@ -0,0 +1,120 @@
+#ifndef CRASY_TIMER_WHEEL_HPP
+#define CRASY_TIMER_WHEEL_HPP
+
+#include <crasy/sleep.hpp>
+
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wuseless-cast"
+#pragma GCC diagnostic ignored "-Wconversion"
+#endif
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace crasy::detail {
+
+// Hierarchical timing wheel, after Varghese and Lauck, "Hashed and
+// Hierarchical Timing Wheels" (SOSP'87), laid out as in Tokio's timer.
+//
+// Time is counted in ticks of one microsecond since the wheel was created.
+// Each of the LEVELS levels has 64 slots, and a slot at level `n` spans
+// 64^n ticks, so the wheel covers 2^42 ticks, or about 51 days; later
+// deadlines are parked in the last slot and placed again once it is
+// reached. A timer goes in the lowest level at which its deadline falls in
+// a later slot than the current time, so adding and cancelling a timer are
+// O(1), and each timer moves down at most LEVELS - 1 times before it fires.
+// A bitmap of the occupied slots of each level finds the next deadline
+// without scanning empty slots.
+//
+// A timer with slack is moved to the coarsest tick boundary within its slack
+// window, so that timers whose windows overlap tend to land in the same tick
+// and fire together.
+//
+// The wheel keeps a single asio timer armed for its earliest deadline, which
+// is what wakes up a parked thread, and fires every due timer when it goes
+// off. Timers may be cancelled from any thread, so the wheel is guarded by a
+// mutex, which in practice is only ever contended by such cancellations.
+// Timers with a `fire` callback are fired once the mutex is released, so
+// that the callback can take locks of its own; until it returns, the node
+// points at firing_wheel(), and cancelling the timer waits.
+class timer_wheel {
+  public:
+    // Timers without a slack of their own take `default_slack`, which is
+    // read whenever one is armed
+    timer_wheel(asio::io_context& context,
+                const std::atomic<std::chrono::microseconds>& default_slack);
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel(timer_wheel&&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+    timer_wheel& operator=(timer_wheel&&) = delete;
+
+    // Arms the timer, unless its deadline has already passed, in which case
+    // this returns false
+    bool add(timer_node& node);
+
+    void cancel(timer_node& node);
+
+    // Fires the timer now, if it is still armed
+    void expire(timer_node& node);
+
+  private:
+    static inline constexpr std::size_t LEVELS = 7;
+    static inline constexpr std::size_t SLOT_BITS = 6;
+    static inline constexpr std::uint64_t SLOTS = 1 << SLOT_BITS;
+    static inline constexpr std::uint64_t SLOT_MASK = SLOTS - 1;
+    static inline constexpr std::uint64_t WHEEL_RANGE = std::uint64_t{1}
+                                                        << (LEVELS * SLOT_BITS);
+
+    using clock = std::chrono::steady_clock;
+
+    struct level {
+        std::uint64_t occupied{0};
+        std::array<timer_node*, SLOTS> slots{};
+    };
+
+    static std::uint64_t coarsen(std::uint64_t when, std::uint64_t slack);
+    std::uint64_t ticks_until(clock::time_point deadline) const;
+    clock::time_point time_of(std::uint64_t ticks) const;
+
+    void insert(timer_node& node);
+    void unlink(timer_node& node);
+    bool next_expiration(std::uint64_t& ticks, std::size_t& lvl,
+                         std::size_t& slot) const;
+    // Timers with a callback are left linked through `next` in `fired`
+    void fire_due(clock::time_point now, timer_node*& fired);
+    void arm();
+    void on_timer();
+
+    std::mutex mut_;
+    const std::atomic<std::chrono::microseconds>* default_slack_;
+    clock::time_point epoch_;
+    // ticks up to which every slot has been processed
+    std::uint64_t elapsed_{0};
+    std::array<level, LEVELS> levels_;
+    // the context the wheel's timers fire on
+    asio::io_context* context_;
+    asio::steady_timer timer_;
+    // when timer_ is set to go off, if it is waiting
+    clock::time_point armed_{clock::time_point::max()};
+};
+
+// What the `wheel` of a timer whose callback is running points at
+inline timer_wheel* firing_wheel() {
+    return reinterpret_cast<timer_wheel*>(std::uintptr_t{1});
+}
+
+} // namespace crasy::detail
+
+#endif
@@ -3,6 +3,15 @@
 #include <crasy/udp.hpp>
 #include "internal.hpp"
 
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+#endif
+#include <asio/bind_cancellation_slot.hpp>
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
 namespace crasy {
 
 udp_socket::udp_socket() : sock_(detail::context()) {}
@@ -34,14 +43,16 @@ struct connect_future : public detail::io_future {
 
     void start(asio::ip::udp::socket& socket,
                const asio::ip::udp::endpoint& ep) {
-        socket.async_connect(ep, [this](const auto& ec) {
-            if (ec) {
-                ret.emplace(err(ec));
-            } else {
-                ret.emplace(ok());
-            }
-            this->finish();
-        });
+        socket.async_connect(
+            ep, asio::bind_cancellation_slot(
+                    this->cancellation_slot(), [this](const auto& ec) {
+                        if (ec) {
+                            ret.emplace(err(ec));
+                        } else {
+                            ret.emplace(ok());
+                        }
+                        this->finish();
+                    }));
     }
 
     result<void> await_resume() { return *std::move(ret); }
@@ -81,15 +92,17 @@ struct send_future : public detail::io_future {
 
     template <typename T>
     void start(asio::ip::udp::socket& socket, std::span<const T> buffer) {
-        socket.async_send(asio_buffer(buffer),
-                          [this](const auto& ec, auto cnt) {
-                              if (ec) {
-                                  ret.emplace(err(ec));
-                              } else {
-                                  ret.emplace(ok(cnt));
-                              }
-                              this->finish();
-                          });
+        socket.async_send(
+            asio_buffer(buffer),
+            asio::bind_cancellation_slot(
+                this->cancellation_slot(), [this](const auto& ec, auto cnt) {
+                    if (ec) {
+                        ret.emplace(err(ec));
+                    } else {
+                        ret.emplace(ok(cnt));
+                    }
+                    this->finish();
+                }));
     }
 
     result<std::size_t> await_resume() { return *std::move(ret); }
@@ -109,15 +122,17 @@ struct send_to_future : public detail::io_future {
     void start(asio::ip::udp::socket& socket,
                std::span<const T> buffer,
                const asio::ip::udp::endpoint& peer) {
-        socket.async_send_to(asio_buffer(buffer), peer,
-                             [this](const auto& ec, auto cnt) {
-                                 if (ec) {
-                                     ret.emplace(err(ec));
-                                 } else {
-                                     ret.emplace(ok(cnt));
-                                 }
-                                 this->finish();
-                             });
+        socket.async_send_to(
+            asio_buffer(buffer), peer,
+            asio::bind_cancellation_slot(
+                this->cancellation_slot(), [this](const auto& ec, auto cnt) {
+                    if (ec) {
+                        ret.emplace(err(ec));
+                    } else {
+                        ret.emplace(ok(cnt));
+                    }
+                    this->finish();
+                }));
     }
 
     result<std::size_t> await_resume() { return *std::move(ret); }
@@ -139,15 +154,17 @@ struct recv_future : public detail::io_future {
 
     template <typename T>
     void start(asio::ip::udp::socket& socket, std::span<T> buffer) {
-        socket.async_receive(asio_buffer(buffer),
-                             [this](const auto& ec, auto cnt) {
-                                 if (ec) {
-                                     ret.emplace(err(ec));
-                                 } else {
-                                     ret.emplace(ok(cnt));
-                                 }
-                                 this->finish();
-                             });
+        socket.async_receive(
+            asio_buffer(buffer),
+            asio::bind_cancellation_slot(
+                this->cancellation_slot(), [this](const auto& ec, auto cnt) {
+                    if (ec) {
+                        ret.emplace(err(ec));
+                    } else {
+                        ret.emplace(ok(cnt));
+                    }
+                    this->finish();
+                }));
     }
 
     result<std::size_t> await_resume() { return *std::move(ret); }
@@ -166,15 +183,17 @@ struct recv_from_future : public detail::io_future {
     void start(asio::ip::udp::socket& socket,
                std::span<T> buffer,
                asio::ip::udp::endpoint& asio_ep) {
-        socket.async_receive_from(asio_buffer(buffer), asio_ep,
-                                  [this](const auto& ec, auto cnt) {
-                                      if (ec) {
-                                          ret.emplace(err(ec));
-                                      } else {
-                                          ret.emplace(ok(cnt));
-                                      }
-                                      this->finish();
-                                  });
+        socket.async_receive_from(
+            asio_buffer(buffer), asio_ep,
+            asio::bind_cancellation_slot(
+                this->cancellation_slot(), [this](const auto& ec, auto cnt) {
+                    if (ec) {
+                        ret.emplace(err(ec));
+                    } else {
+                        ret.emplace(ok(cnt));
+                    }
+                    this->finish();
+                }));
     }
 
     result<std::size_t> await_resume() { return *std::move(ret); }
@@ -205,14 +224,16 @@ struct wait_future : public detail::io_future {
 
     void start(asio::ip::udp::socket& sock,
                asio::ip::udp::socket::wait_type type) {
-        sock.async_wait(type, [this](const auto& ec) {
-            if (ec) {
-                ret.emplace(err(ec));
-            } else {
-                ret.emplace(ok());
-            }
-            this->finish();
-        });
+        sock.async_wait(
+            type, asio::bind_cancellation_slot(
+                      this->cancellation_slot(), [this](const auto& ec) {
+                          if (ec) {
+                              ret.emplace(err(ec));
+                          } else {
+                              ret.emplace(ok());
+                          }
+                          this->finish();
+                      }));
     }
 
     result<void> await_resume() { return *std::move(ret); }
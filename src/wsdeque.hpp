@@ -0,0 +1,130 @@
+#ifndef CRASY_WSDEQUE_HPP
+#define CRASY_WSDEQUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <crasy/option.hpp>
+
+namespace crasy {
+
+// Chase-Lev work-stealing deque, after Le, Pop, Cohen and Zappa Nardelli,
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP'13).
+//
+// Only the owning thread may push() and pop(). pop() takes the most recently
+// pushed value, while any thread may steal() the oldest one. The buffer grows
+// as needed; retired buffers are kept until the deque is destroyed, since a
+// thief may still be reading from one.
+template <typename T>
+class wsdeque {
+  private:
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "wsdeque values must be trivially copyable");
+
+    struct buffer_t {
+        explicit buffer_t(std::size_t cap)
+            : mask(cap - 1), data(new std::atomic<T>[cap]) {}
+
+        std::size_t capacity() const { return mask + 1; }
+
+        T get(std::int64_t idx) const {
+            return data[static_cast<std::size_t>(idx) & mask].load(
+                std::memory_order_relaxed);
+        }
+
+        void put(std::int64_t idx, T value) {
+            data[static_cast<std::size_t>(idx) & mask].store(
+                value, std::memory_order_relaxed);
+        }
+
+        std::size_t mask;
+        std::unique_ptr<std::atomic<T>[]> data;
+    };
+
+    alignas(64) std::atomic<std::int64_t> top_{0};
+    alignas(64) std::atomic<std::int64_t> bottom_{0};
+    std::atomic<buffer_t*> buffer_;
+    std::vector<std::unique_ptr<buffer_t>> buffers_;
+
+    buffer_t* grow(buffer_t* old, std::int64_t bottom, std::int64_t top) {
+        auto next = std::make_unique<buffer_t>(old->capacity() * 2);
+        for (auto i = top; i != bottom; ++i) { next->put(i, old->get(i)); }
+        auto ret = next.get();
+        buffers_.push_back(std::move(next));
+        buffer_.store(ret, std::memory_order_release);
+        return ret;
+    }
+
+  public:
+    explicit wsdeque(std::size_t initial_capacity = 256) {
+        std::size_t cap = 1;
+        while (cap < initial_capacity) { cap <<= 1; }
+        buffers_.push_back(std::make_unique<buffer_t>(cap));
+        buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+    }
+
+    wsdeque(const wsdeque&) = delete;
+    wsdeque(wsdeque&&) = delete;
+    ~wsdeque() = default;
+    wsdeque& operator=(const wsdeque&) = delete;
+    wsdeque& operator=(wsdeque&&) = delete;
+
+    void push(T value) {
+        auto bottom = bottom_.load(std::memory_order_relaxed);
+        auto top = top_.load(std::memory_order_acquire);
+        auto buf = buffer_.load(std::memory_order_relaxed);
+        if (static_cast<std::size_t>(bottom - top) >= buf->capacity()) {
+            buf = grow(buf, bottom, top);
+        }
+        buf->put(bottom, value);
+        bottom_.store(bottom + 1, std::memory_order_release);
+    }
+
+    option<T> pop() {
+        auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        auto buf = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        auto value = buf->get(bottom);
+        if (top == bottom) {
+            // last value, race against thieves for it
+            auto won = top_.compare_exchange_strong(
+                top, top + 1, std::memory_order_seq_cst,
+                std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            if (!won) { return std::nullopt; }
+        }
+        return value;
+    }
+
+    option<T> steal() {
+        auto top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) { return std::nullopt; }
+        auto value = buffer_.load(std::memory_order_acquire)->get(top);
+        if (!top_.compare_exchange_strong(top, top + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    bool empty() const {
+        return bottom_.load(std::memory_order_relaxed) <=
+               top_.load(std::memory_order_relaxed);
+    }
+};
+
+} // namespace crasy
+
+#endif
@@ -0,0 +1,62 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <stop_token>
+#include <thread>
+
+using namespace crasy_test;
+
+static crasy::future<void> awaits_nested(std::atomic<bool>& cancelled) {
+    co_await sleep_until_cancelled(cancelled);
+}
+
+// Requests stop from another thread once the wait has started
+static std::jthread stop_later(std::stop_source& stop) {
+    return std::jthread{[&stop] {
+        std::this_thread::sleep_for(5ms);
+        stop.request_stop();
+    }};
+}
+
+static crasy::future<void> stop_while_waiting() {
+    std::stop_source stop;
+    auto stopper = stop_later(stop);
+    auto start = steady::now();
+    co_await crasy::with_cancellation(crasy::sleep_for(FOREVER),
+                                      stop.get_token());
+    CHECK(since(start) < PROMPTLY);
+}
+
+static crasy::future<void> stop_before_waiting() {
+    std::stop_source stop;
+    stop.request_stop();
+    auto start = steady::now();
+    co_await crasy::with_cancellation(crasy::sleep_for(FOREVER),
+                                      stop.get_token());
+    CHECK(since(start) < PROMPTLY);
+}
+
+static crasy::future<void> cancel_future() {
+    std::atomic<bool> cancelled{false};
+    auto fut = sleep_until_cancelled(cancelled);
+    fut.cancel();
+    co_await fut;
+    CHECK(cancelled);
+}
+
+static crasy::future<void> cancel_nested() {
+    // cancelling a future cancels the future it awaits
+    std::atomic<bool> cancelled{false};
+    auto fut = awaits_nested(cancelled);
+    fut.cancel();
+    co_await fut;
+    CHECK(cancelled);
+}
+
+int main() {
+    run("stop requested while waiting", stop_while_waiting);
+    run("stop requested before waiting", stop_before_waiting);
+    run("future cancelled", cancel_future);
+    run("future cancelled while nested", cancel_nested);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef CRASY_TEST_CHECK_HPP
+#define CRASY_TEST_CHECK_HPP
+
+#include <crasy/crasy.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+
+// Fails the test at the first condition that does not hold. Unlike assert(),
+// it is kept in release builds.
+#define CHECK(cond) ::crasy_test::check((cond), #cond, __FILE__, __LINE__)
+
+namespace crasy_test {
+
+using namespace std::chrono_literals;
+using steady = std::chrono::steady_clock;
+
+// Longer than any test runs, so that a sleep this long only ends early if it
+// is cancelled
+inline constexpr std::chrono::seconds FOREVER{60};
+
+// Bound on how long something that should be prompt may take, which is kept
+// loose, so that a busy machine does not fail the tests
+inline constexpr std::chrono::seconds PROMPTLY{5};
+
+inline void check(bool ok, const char* what, const char* file, int line) {
+    if (!ok) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+inline steady::duration since(steady::time_point start) {
+    return steady::now() - start;
+}
+
+// Sleeps until cancelled, and records that it was as the last thing it
+// does, so that a future that was let go of is done once this is seen
+template <typename T = void>
+crasy::future<T> sleep_until_cancelled(std::atomic<bool>& cancelled) {
+    auto start = steady::now();
+    co_await crasy::sleep_for(FOREVER);
+    cancelled = since(start) < FOREVER;
+    if constexpr (!std::is_void_v<T>) { co_return T{}; }
+}
+
+// Waits for a future let go of to set `flag` as it unwinds
+inline crasy::future<void> wait_for(const std::atomic<bool>& flag) {
+    auto start = steady::now();
+    while (!flag && since(start) < PROMPTLY) {
+        co_await crasy::sleep_for(1ms);
+    }
+    CHECK(flag);
+}
+
+// Runs a test on a local executor, and on executors in both modes
+template <typename F>
+void run(const char* name, F test) {
+    std::printf("%s\n", name);
+    std::fflush(stdout);
+    crasy::local_executor{}.block_on(test);
+    crasy::executor{2}.block_on(test);
+    crasy::executor{2, crasy::executor::DEFAULT_MAX_BLOCKING_THREADS,
+                    crasy::executor_mode::sharded}
+        .block_on(test);
+}
+
+} // namespace crasy_test
+
+#endif
@@ -0,0 +1,114 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace crasy_test;
+
+static crasy::future<int> value_after(steady::duration delay, int value) {
+    co_await crasy::sleep_for(delay);
+    co_return value;
+}
+
+static crasy::future<int> throw_after(steady::duration delay) {
+    co_await crasy::sleep_for(delay);
+    throw std::runtime_error("failed");
+}
+
+static crasy::future<bool> await_next(crasy::future_set<int>& set) {
+    auto value = co_await set.next();
+    co_return value.has_value();
+}
+
+static crasy::future<void> completion_order() {
+    crasy::future_set<int> set;
+    set.push(value_after(30ms, 3));
+    set.push(value_after(10ms, 1));
+    set.push(value_after(20ms, 2));
+    CHECK(set.size() == 3);
+    std::vector<int> order;
+    while (auto value = co_await set.next()) { order.push_back(*value); }
+    CHECK(order == std::vector<int>({1, 2, 3}));
+    CHECK(set.empty());
+    // an empty set yields nothing right away
+    CHECK(!(co_await set.next()).has_value());
+    CHECK(!set.try_next().has_value());
+}
+
+static crasy::future<void> pushed_while_running() {
+    crasy::future_set<int> set;
+    set.push(value_after(10ms, 1));
+    CHECK(*co_await set.next() == 1);
+    set.push(value_after(5ms, 2));
+    set.push(value_after(1ms, 3));
+    CHECK(*co_await set.next() == 3);
+    CHECK(*co_await set.next() == 2);
+}
+
+static crasy::future<void> rethrows() {
+    crasy::future_set<int> set;
+    set.push(value_after(10ms, 1));
+    set.push(throw_after(1ms));
+    std::string what;
+    try {
+        co_await set.next();
+    } catch (const std::runtime_error& ex) {
+        what = ex.what();
+    }
+    CHECK(what == "failed");
+    // the rest of the set carries on
+    CHECK(set.size() == 1);
+    CHECK(*co_await set.next() == 1);
+}
+
+static crasy::future<void> dropped_in_flight() {
+    std::atomic<bool> a{false};
+    std::atomic<bool> b{false};
+    {
+        crasy::future_set<int> set;
+        set.push(sleep_until_cancelled<int>(a));
+        set.push(sleep_until_cancelled<int>(b));
+        set.push(value_after(0ms, 1));
+        CHECK(*co_await set.next() == 1);
+    }
+    // each future left running is cancelled, and frees itself once unwound
+    co_await wait_for(a);
+    co_await wait_for(b);
+}
+
+static crasy::future<void> cancelled_with_the_task() {
+    std::atomic<bool> a{false};
+    std::atomic<bool> b{false};
+    crasy::future_set<int> set;
+    set.push(sleep_until_cancelled<int>(a));
+    set.push(sleep_until_cancelled<int>(b));
+    auto res = co_await crasy::timeout(5ms, await_next(set));
+    CHECK(!res);
+    // cancelled futures still finish, and whatever results the cancelled
+    // wait did not take are left in the set
+    while (auto value = co_await set.next()) { CHECK(*value == 0); }
+    CHECK(a);
+    CHECK(b);
+}
+
+static crasy::future<void> as_stream() {
+    crasy::future_set<int> set;
+    set.push(value_after(10ms, 2));
+    set.push(value_after(1ms, 1));
+    auto results = std::move(set).into_stream();
+    std::vector<int> order;
+    while (auto value = co_await results) { order.push_back(*value); }
+    CHECK(order == std::vector<int>({1, 2}));
+}
+
+int main() {
+    run("future_set completion order", completion_order);
+    run("future_set pushed while running", pushed_while_running);
+    run("future_set rethrows", rethrows);
+    run("future_set dropped in flight", dropped_in_flight);
+    run("future_set cancelled with the task", cancelled_with_the_task);
+    run("future_set as a stream", as_stream);
+    return 0;
+}
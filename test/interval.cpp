@@ -0,0 +1,102 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <stdexcept>
+
+using namespace crasy_test;
+
+// Period of the schedules, and how long the consumer stalls after the first
+// tick, which spans three more ticks
+inline constexpr auto PERIOD = 20ms;
+inline constexpr auto STALL = 70ms;
+
+static crasy::future<void> next_tick(
+    crasy::stream<steady::time_point>& ticks, std::atomic<bool>& ended) {
+    auto tick = co_await ticks;
+    ended = !tick.has_value();
+}
+
+static crasy::future<void> on_schedule() {
+    auto start = steady::now();
+    auto ticks = crasy::interval_at(start, PERIOD);
+    for (int i = 0; i < 4; ++i) {
+        auto tick = co_await ticks;
+        CHECK(tick.has_value());
+        CHECK(*tick == start + i * PERIOD);
+        // never taken early
+        CHECK(steady::now() >= *tick);
+    }
+}
+
+static crasy::future<void> burst() {
+    auto start = steady::now();
+    auto ticks = crasy::interval_at(start, PERIOD, crasy::missed_tick::burst);
+    CHECK(*co_await ticks == start);
+    co_await crasy::sleep_for(STALL);
+    // the missed ticks come right away, on their original schedule, and
+    // the schedule carries on from there
+    for (int i = 1; i <= 4; ++i) {
+        auto tick = co_await ticks;
+        CHECK(*tick == start + i * PERIOD);
+        CHECK(steady::now() >= *tick);
+    }
+}
+
+static crasy::future<void> delay() {
+    auto start = steady::now();
+    auto ticks = crasy::interval_at(start, PERIOD, crasy::missed_tick::delay);
+    CHECK(*co_await ticks == start);
+    co_await crasy::sleep_for(STALL);
+    auto back = steady::now();
+    // the first missed tick is taken late, and the next comes a whole
+    // period after that
+    CHECK(*co_await ticks == start + PERIOD);
+    auto next = *co_await ticks;
+    CHECK(next >= back + PERIOD);
+    CHECK(steady::now() >= next);
+}
+
+static crasy::future<void> skip() {
+    auto start = steady::now();
+    auto ticks = crasy::interval_at(start, PERIOD, crasy::missed_tick::skip);
+    CHECK(*co_await ticks == start);
+    co_await crasy::sleep_for(STALL);
+    auto back = steady::now();
+    CHECK(*co_await ticks == start + PERIOD);
+    auto taken = steady::now();
+    // the other missed ticks are dropped, and the next is the first of the
+    // original schedule after the stall
+    auto next = *co_await ticks;
+    CHECK((next - start) % PERIOD == steady::duration::zero());
+    CHECK(next > back);
+    CHECK(next <= taken + PERIOD);
+    CHECK(steady::now() >= next);
+}
+
+static crasy::future<void> cancelled_while_waiting() {
+    auto ticks = crasy::interval(FOREVER);
+    CHECK((co_await ticks).has_value());
+    std::atomic<bool> ended{false};
+    auto res = co_await crasy::timeout(5ms, next_tick(ticks, ended));
+    CHECK(!res);
+    CHECK(ended);
+}
+
+static crasy::future<void> bad_period() {
+    bool threw = false;
+    try {
+        static_cast<void>(crasy::interval(steady::duration::zero()));
+    } catch (const std::invalid_argument&) { threw = true; }
+    CHECK(threw);
+    co_return;
+}
+
+int main() {
+    run("interval on schedule", on_schedule);
+    run("interval bursts missed ticks", burst);
+    run("interval delays after missed ticks", delay);
+    run("interval skips missed ticks", skip);
+    run("interval cancelled while waiting", cancelled_while_waiting);
+    run("interval with a bad period", bad_period);
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+using namespace crasy_test;
+
+using str_result = crasy::result<int, std::string>;
+
+static crasy::future<int> value_after(steady::duration delay, int value) {
+    co_await crasy::sleep_for(delay);
+    co_return value;
+}
+
+static crasy::future<void> nothing_after(steady::duration delay) {
+    co_await crasy::sleep_for(delay);
+}
+
+static crasy::future<void> throw_after(steady::duration delay,
+                                       std::string what, bool& finished) {
+    co_await crasy::sleep_for(delay);
+    finished = true;
+    throw std::runtime_error(what);
+}
+
+static crasy::future<str_result> ok_after(steady::duration delay, int value) {
+    co_await crasy::sleep_for(delay);
+    co_return crasy::ok(value);
+}
+
+static crasy::future<str_result> fail_after(steady::duration delay,
+                                            std::string error) {
+    co_await crasy::sleep_for(delay);
+    co_return crasy::err(std::move(error));
+}
+
+static crasy::future<str_result> ok_unless_cancelled(
+    std::atomic<bool>& cancelled) {
+    co_await sleep_until_cancelled(cancelled);
+    co_return crasy::ok(0);
+}
+
+static crasy::future<void> values() {
+    auto [a, b, c] = co_await crasy::join(
+        value_after(2ms, 1), nothing_after(1ms), value_after(0ms, 3));
+    CHECK(a == 1);
+    CHECK(b == std::monostate{});
+    CHECK(c == 3);
+}
+
+static crasy::future<void> first_thrower_in_order() {
+    // the second throws first, but the first in argument order wins, once
+    // both have finished
+    bool first = false;
+    bool second = false;
+    std::string what;
+    try {
+        co_await crasy::join(throw_after(10ms, "first", first),
+                             throw_after(0ms, "second", second));
+    } catch (const std::runtime_error& ex) {
+        what = ex.what();
+    }
+    CHECK(what == "first");
+    CHECK(first);
+    CHECK(second);
+}
+
+static crasy::future<void> join_all_in_order() {
+    std::vector<crasy::future<int>> futures;
+    for (int i = 0; i < 8; ++i) {
+        futures.push_back(value_after(std::chrono::milliseconds(8 - i), i));
+    }
+    auto values = co_await crasy::join_all(std::move(futures));
+    CHECK(values == std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+}
+
+static crasy::future<void> join_all_first_thrower() {
+    bool first = false;
+    bool second = false;
+    std::vector<crasy::future<void>> futures;
+    futures.push_back(throw_after(10ms, "first", first));
+    futures.push_back(throw_after(0ms, "second", second));
+    std::string what;
+    try {
+        co_await crasy::join_all(std::move(futures));
+    } catch (const std::runtime_error& ex) {
+        what = ex.what();
+    }
+    CHECK(what == "first");
+    CHECK(first);
+}
+
+static crasy::future<void> try_join_ok() {
+    auto res = co_await crasy::try_join<std::string>(ok_after(1ms, 1),
+                                                     ok_after(0ms, 2));
+    CHECK(res.is_ok());
+    CHECK(res.ok() == std::make_tuple(1, 2));
+}
+
+static crasy::future<void> try_join_first_failure() {
+    // the first to fail in time, rather than in argument order, gives the
+    // error, and has the others cancelled
+    std::atomic<bool> cancelled{false};
+    auto start = steady::now();
+    auto res = co_await crasy::try_join<std::string>(
+        fail_after(10ms, "late"), fail_after(1ms, "early"),
+        ok_unless_cancelled(cancelled));
+    CHECK(!res);
+    CHECK(res.err() == "early");
+    CHECK(cancelled);
+    CHECK(since(start) < PROMPTLY);
+}
+
+static crasy::future<void> try_join_all_failure() {
+    std::atomic<bool> cancelled{false};
+    std::vector<crasy::future<str_result>> futures;
+    futures.push_back(ok_unless_cancelled(cancelled));
+    futures.push_back(fail_after(1ms, "failed"));
+    futures.push_back(ok_after(0ms, 3));
+    auto res = co_await crasy::try_join_all(std::move(futures));
+    CHECK(!res);
+    CHECK(res.err() == "failed");
+    CHECK(cancelled);
+}
+
+int main() {
+    run("join values", values);
+    run("join rethrows the first thrower in order", first_thrower_in_order);
+    run("join_all values in order", join_all_in_order);
+    run("join_all rethrows the first thrower in order",
+        join_all_first_thrower);
+    run("try_join values", try_join_ok);
+    run("try_join first failure", try_join_first_failure);
+    run("try_join_all first failure", try_join_all_failure);
+    return 0;
+}
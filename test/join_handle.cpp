@@ -0,0 +1,78 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace crasy_test;
+
+static crasy::future<int> value_after(steady::duration delay, int value) {
+    co_await crasy::sleep_for(delay);
+    co_return value;
+}
+
+static crasy::future<int> throw_after(steady::duration delay) {
+    co_await crasy::sleep_for(delay);
+    throw std::runtime_error("task");
+}
+
+static crasy::future<int> yield_then(int value) {
+    co_await crasy::yield_now();
+    co_return value;
+}
+
+static crasy::future<void> set_after(steady::duration delay,
+                                     std::atomic<bool>& done) {
+    co_await crasy::sleep_for(delay);
+    done = true;
+}
+
+static crasy::future<void> awaited_before_done() {
+    auto handle = crasy::spawn(value_after(5ms, 1));
+    CHECK(co_await handle == 1);
+}
+
+static crasy::future<void> awaited_after_done() {
+    auto handle = crasy::spawn(value_after(0ms, 2));
+    co_await crasy::sleep_for(5ms);
+    CHECK(co_await handle == 2);
+}
+
+static crasy::future<void> rethrows() {
+    auto handle = crasy::spawn(throw_after(1ms));
+    std::string what;
+    try {
+        co_await handle;
+    } catch (const std::runtime_error& ex) {
+        what = ex.what();
+    }
+    CHECK(what == "task");
+}
+
+static crasy::future<void> many() {
+    // tasks finishing on any thread, before or while they are awaited
+    std::vector<crasy::join_handle<int>> handles;
+    for (int i = 0; i < 1000; ++i) {
+        handles.push_back(crasy::spawn([i] { return yield_then(i); }));
+    }
+    long sum = 0;
+    for (auto& handle : handles) { sum += co_await handle; }
+    CHECK(sum == 999L * 1000 / 2);
+}
+
+static crasy::future<void> detached() {
+    // dropping the handle leaves the task to run on its own
+    std::atomic<bool> done{false};
+    static_cast<void>(crasy::spawn(set_after(1ms, done)));
+    co_await wait_for(done);
+}
+
+int main() {
+    run("join_handle awaited before the task is done", awaited_before_done);
+    run("join_handle awaited after the task is done", awaited_after_done);
+    run("join_handle rethrows", rethrows);
+    run("join_handle for many tasks", many);
+    run("join_handle dropped", detached);
+    return 0;
+}
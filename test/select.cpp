@@ -0,0 +1,71 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <variant>
+
+using namespace crasy_test;
+
+static crasy::future<int> value_after(steady::duration delay, int value) {
+    co_await crasy::sleep_for(delay);
+    co_return value;
+}
+
+static crasy::future<std::size_t> select_cancellable(std::atomic<bool>& a,
+                                                     std::atomic<bool>& b) {
+    auto res = co_await crasy::select(sleep_until_cancelled(a),
+                                      sleep_until_cancelled(b));
+    co_return res.index();
+}
+
+static crasy::future<void> winner() {
+    std::atomic<bool> cancelled{false};
+    auto start = steady::now();
+    auto res = co_await crasy::select(sleep_until_cancelled(cancelled),
+                                      value_after(1ms, 5));
+    CHECK(res.index() == 1);
+    CHECK(std::get<1>(res) == 5);
+    CHECK(since(start) < PROMPTLY);
+    // the loser is let go of, and cancelled as it goes
+    co_await wait_for(cancelled);
+}
+
+static crasy::future<void> first_of_several() {
+    std::atomic<bool> a{false};
+    std::atomic<bool> b{false};
+    auto res = co_await crasy::select(sleep_until_cancelled<int>(a),
+                                      sleep_until_cancelled<int>(b),
+                                      value_after(1ms, 2));
+    CHECK(res.index() == 2);
+    CHECK(std::get<2>(res) == 2);
+    co_await wait_for(a);
+    co_await wait_for(b);
+}
+
+static crasy::future<void> sleep_branch() {
+    std::atomic<bool> cancelled{false};
+    auto start = steady::now();
+    auto res = co_await crasy::select(sleep_until_cancelled(cancelled),
+                                      crasy::sleep_for(5ms));
+    CHECK(res.index() == 1);
+    CHECK(since(start) >= 5ms);
+    co_await wait_for(cancelled);
+}
+
+static crasy::future<void> cancelled_with_the_task() {
+    std::atomic<bool> a{false};
+    std::atomic<bool> b{false};
+    auto res = co_await crasy::timeout(5ms, select_cancellable(a, b));
+    CHECK(!res);
+    // the first branch to unwind wins, and the other is let go of
+    co_await wait_for(a);
+    co_await wait_for(b);
+}
+
+int main() {
+    run("select winner", winner);
+    run("select first of several", first_of_several);
+    run("select with a sleep", sleep_branch);
+    run("select cancelled with the task", cancelled_with_the_task);
+    return 0;
+}
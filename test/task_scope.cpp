@@ -0,0 +1,138 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace crasy_test;
+
+static crasy::future<void> store_after(steady::duration delay, int value,
+                                       int& out) {
+    co_await crasy::sleep_for(delay);
+    out = value;
+}
+
+static crasy::future<void> throw_after(steady::duration delay,
+                                       std::string what) {
+    co_await crasy::sleep_for(delay);
+    throw std::runtime_error(what);
+}
+
+static crasy::future<void> children_borrow() {
+    std::vector<int> out(4, -1);
+    co_await crasy::scoped(
+        [&](crasy::task_scope& scope) -> crasy::future<void> {
+            for (std::size_t i = 0; i < out.size(); ++i) {
+                auto value = static_cast<int>(i);
+                scope.spawn([&, i, value] {
+                    return store_after(std::chrono::milliseconds(4 - i),
+                                       value, out[i]);
+                });
+            }
+            co_return;
+        });
+    // every child is done by the time scoped returns
+    CHECK(out == std::vector<int>({0, 1, 2, 3}));
+}
+
+static crasy::future<void> returns_value() {
+    int child = 0;
+    auto value = co_await crasy::scoped(
+        [&](crasy::task_scope& scope) -> crasy::future<int> {
+            scope.spawn([&] { return store_after(1ms, 2, child); });
+            co_return 1;
+        });
+    CHECK(value == 1);
+    CHECK(child == 2);
+}
+
+static crasy::future<void> child_throws() {
+    std::atomic<bool> cancelled{false};
+    std::string what;
+    try {
+        co_await crasy::scoped(
+            [&](crasy::task_scope& scope) -> crasy::future<void> {
+                scope.spawn([&] { return sleep_until_cancelled(cancelled); });
+                scope.spawn([] { return throw_after(1ms, "child"); });
+                co_await scope.join();
+            });
+    } catch (const std::runtime_error& ex) {
+        what = ex.what();
+    }
+    CHECK(what == "child");
+    // the other child was cancelled, and had finished before scoped returned
+    CHECK(cancelled);
+}
+
+static crasy::future<void> body_throws_first() {
+    std::atomic<bool> cancelled{false};
+    std::string what;
+    try {
+        co_await crasy::scoped(
+            [&](crasy::task_scope& scope) -> crasy::future<void> {
+                scope.spawn([&] { return sleep_until_cancelled(cancelled); });
+                scope.spawn([] { return throw_after(0ms, "child"); });
+                co_await crasy::sleep_for(5ms);
+                throw std::runtime_error("body");
+            });
+    } catch (const std::runtime_error& ex) {
+        what = ex.what();
+    }
+    // the body's exception wins over the child's, though it came later
+    CHECK(what == "body");
+    CHECK(cancelled);
+}
+
+static crasy::future<void> spawned_after_failure() {
+    std::atomic<bool> late{false};
+    std::string what;
+    try {
+        co_await crasy::scoped(
+            [&](crasy::task_scope& scope) -> crasy::future<void> {
+                scope.spawn([] { return throw_after(0ms, "child"); });
+                co_await crasy::sleep_for(5ms);
+                // spawned once the scope has failed, so cancelled right away
+                scope.spawn([&] { return sleep_until_cancelled(late); });
+            });
+    } catch (const std::runtime_error& ex) {
+        what = ex.what();
+    }
+    CHECK(what == "child");
+    CHECK(late);
+}
+
+static crasy::future<void> cancel_scope(std::atomic<bool>& a,
+                                        std::atomic<bool>& b,
+                                        std::atomic<bool>& body) {
+    co_await crasy::scoped(
+        [&](crasy::task_scope& scope) -> crasy::future<void> {
+            scope.spawn([&] { return sleep_until_cancelled(a); });
+            scope.spawn([&] { return sleep_until_cancelled(b); });
+            co_await sleep_until_cancelled(body);
+        });
+}
+
+static crasy::future<void> cancelled_with_the_task() {
+    std::atomic<bool> a{false};
+    std::atomic<bool> b{false};
+    std::atomic<bool> body{false};
+    auto start = steady::now();
+    auto res = co_await crasy::timeout(5ms, cancel_scope(a, b, body));
+    CHECK(!res);
+    CHECK(since(start) < PROMPTLY);
+    CHECK(body);
+    CHECK(a);
+    CHECK(b);
+}
+
+int main() {
+    run("task_scope children borrow", children_borrow);
+    run("task_scope returns the body's value", returns_value);
+    run("task_scope child throws", child_throws);
+    run("task_scope body throws first", body_throws_first);
+    run("task_scope spawned after failure", spawned_after_failure);
+    run("task_scope cancelled with the task", cancelled_with_the_task);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "check.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+using namespace crasy_test;
+
+static crasy::future<int> value_after(steady::duration delay, int value) {
+    co_await crasy::sleep_for(delay);
+    co_return value;
+}
+
+static crasy::future<int> throw_after(steady::duration delay) {
+    co_await crasy::sleep_for(delay);
+    throw std::runtime_error("inner");
+}
+
+static crasy::future<void> fires() {
+    std::atomic<bool> cancelled{false};
+    auto start = steady::now();
+    auto res =
+        co_await crasy::timeout(10ms, sleep_until_cancelled<int>(cancelled));
+    CHECK(!res);
+    CHECK(since(start) >= 10ms);
+    CHECK(since(start) < PROMPTLY);
+    // the task resumes once the future has unwound
+    CHECK(cancelled);
+}
+
+static crasy::future<void> loses() {
+    auto start = steady::now();
+    auto res = co_await crasy::timeout(FOREVER, value_after(1ms, 42));
+    CHECK(res.is_ok());
+    CHECK(res.ok() == 42);
+    CHECK(since(start) < PROMPTLY);
+}
+
+static crasy::future<void> rethrows() {
+    std::string what;
+    try {
+        co_await crasy::timeout(FOREVER, throw_after(1ms));
+    } catch (const std::runtime_error& ex) {
+        what = ex.what();
+    }
+    CHECK(what == "inner");
+}
+
+static crasy::future<void> deadline_at() {
+    auto start = steady::now();
+    auto res = co_await crasy::timeout_at(start + 10ms,
+                                          value_after(FOREVER, 1));
+    CHECK(!res);
+    CHECK(since(start) >= 10ms);
+}
+
+static crasy::future<void> join_handle_keeps_running() {
+    auto handle = crasy::spawn(value_after(30ms, 7));
+    auto res = co_await crasy::timeout(1ms, handle);
+    CHECK(!res);
+    // the wait timed out, not the task
+    CHECK(co_await handle == 7);
+}
+
+int main() {
+    run("timeout fires", fires);
+    run("timeout loses", loses);
+    run("timeout rethrows", rethrows);
+    run("timeout_at fires", deadline_at);
+    run("timeout on a join_handle", join_handle_keeps_running);
+    return 0;
+}
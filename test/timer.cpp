@@ -0,0 +1,100 @@
+#include "check.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using namespace crasy_test;
+
+// The timing wheel behind sleeps counts in ticks of 1 us, in levels of 64
+// slots each 64 times wider than those of the level below, so that these
+// deadlines land in the first four levels, and the later ones move down
+// through the others before they fire.
+static const std::vector<steady::duration> LEVEL_DELAYS = {
+    50us, 3ms, 70ms, 300ms};
+
+static crasy::future<steady::time_point> woken_at(steady::time_point deadline) {
+    co_await crasy::sleep_until(deadline);
+    co_return steady::now();
+}
+
+static crasy::future<void> sleep_task(steady::time_point deadline) {
+    co_await crasy::sleep_until(deadline);
+}
+
+// Sleeps until `deadline`, or gives up on it early if `cancel` is set, and
+// returns whether it woke up as it should have
+static crasy::future<bool> sleep_or_cancel(steady::time_point deadline,
+                                           bool cancel) {
+    if (cancel) {
+        auto res = co_await crasy::timeout(1ms, sleep_task(deadline));
+        co_return !res;
+    }
+    co_await crasy::sleep_until(deadline);
+    co_return steady::now() >= deadline;
+}
+
+static crasy::future<void> across_levels() {
+    auto start = steady::now();
+    std::vector<crasy::future<steady::time_point>> sleeps;
+    // pushed latest first, so that they are not armed in deadline order
+    for (auto it = LEVEL_DELAYS.rbegin(); it != LEVEL_DELAYS.rend(); ++it) {
+        sleeps.push_back(woken_at(start + *it));
+    }
+    auto woken = co_await crasy::join_all(std::move(sleeps));
+    std::reverse(woken.begin(), woken.end());
+    for (std::size_t i = 0; i < woken.size(); ++i) {
+        // never early, and not held up until a coarser slot comes around
+        CHECK(woken[i] >= start + LEVEL_DELAYS[i]);
+        CHECK(woken[i] < start + LEVEL_DELAYS[i] + PROMPTLY);
+    }
+    CHECK(std::is_sorted(woken.begin(), woken.end()));
+}
+
+static crasy::future<void> one_after_another() {
+    // each sleep is armed alone, so the wheel moves on from its last firing
+    for (auto delay : LEVEL_DELAYS) {
+        auto start = steady::now();
+        co_await crasy::sleep_for(delay);
+        CHECK(since(start) >= delay);
+    }
+}
+
+static crasy::future<void> cancel_within_slot() {
+    // timers sharing a deadline, of which every other one is cancelled
+    // before it is due, which leaves the rest of its slot to fire on time
+    auto start = steady::now();
+    auto deadline = start + 20ms;
+    std::vector<crasy::future<bool>> sleeps;
+    for (int i = 0; i < 64; ++i) {
+        sleeps.push_back(sleep_or_cancel(deadline, i % 2 == 0));
+    }
+    auto ok = co_await crasy::join_all(std::move(sleeps));
+    CHECK(std::all_of(ok.begin(), ok.end(), [](bool b) { return b; }));
+}
+
+static crasy::future<void> cancel_earliest() {
+    // cancelling the timer the wheel is armed for leaves it to wake up for
+    // the next one
+    auto start = steady::now();
+    auto res = co_await crasy::timeout(5ms, sleep_task(start + FOREVER));
+    CHECK(!res);
+    co_await crasy::sleep_until(start + 10ms);
+    CHECK(since(start) >= 10ms);
+    CHECK(since(start) < PROMPTLY);
+}
+
+static crasy::future<void> with_slack() {
+    auto start = steady::now();
+    co_await crasy::sleep_for(10ms, 5ms);
+    CHECK(since(start) >= 10ms);
+}
+
+int main() {
+    run("timers across levels", across_levels);
+    run("timers one after another", one_after_another);
+    run("timers cancelled within a slot", cancel_within_slot);
+    run("timer cancelled while earliest", cancel_earliest);
+    run("timer with slack", with_slack);
+    return 0;
+}